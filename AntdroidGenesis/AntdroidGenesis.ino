@@ -9,67 +9,376 @@
 
 #include "Debug.h"
 #include "Configuration.h"
+#include "Uart.h"
 #include "Helpers.h"
 #include "Servos.h"
+#include "JointGuard.h"
+#include "Mixer.h"
+#include "Kinematics.h"
+#include "Stability.h"
 #include "Motion.h"
 #include "Motions.h"
+#include "PoseStore.h"
+#include "Protocol.h"
+#include "DeltaCodec.h"
+#include "SetpointStream.h"
+#include "CommandQueue.h"
+#include "ClockSync.h"
+#include "MotionBytecode.h"
+#include "MotionProgram.h"
+#include "PoseLibrary.h"
+#include "Spline.h"
+#include "Gait.h"
+#include "Preview.h"
+#include "Telemetry.h"
 
 typedef enum {
   RELATIVE_INITIAL = 0,
   RELATIVE_CURRENT = 1,
-  ABSOLUTE = 2
+  ABSOLUTE = 2,
+  MANUAL_OFFSET = 3   // Servo commands set an offset in the MIXER_MANUAL layer that stays on top of other moves
 } CONTROL_MODE;
 
 CONTROL_MODE _mode = RELATIVE_INITIAL;
 
+/** Command line being received, handed to setCommand once complete */
+char commandLine[SERIAL_LINE_SIZE + 1];
+uint8_t commandLineLength = 0;
+bool commandLineReady = false;
+bool commandLineOverflow = false;
+
+/** Time the last byte was received */
+unsigned long serialLastByte = 0;
+
+/** A packet arrived during a preview and waits in protocolPayload until it has finished */
+bool serialPacketWaiting = false;
+
+/** Time of the last control tick */
+unsigned long controlLastTick = 0;
+
 void setup()
 {
-  Serial.begin(115200);
-  Serial.println("Antdroid starting...");
+  Uart.begin(SERIAL_BAUD);
+  Uart.println("Antdroid starting...");
 
-  initializeServos();
+  // Carry on from the last stored pose so the first move does not snap from a wrong origin
+  int startPose[SERVO_COUNT];
+  if (poseStoreRestore(startPose))
+    initializeServos(startPose);
+  else
+    initializeServos();
 
   /** DO STUFF */
-  MotionPrepareForStand();
-  delay(1000);
+  MotionBootToStand();
 
-  MotionPushUpright();
-
-  Serial.println("Done!");
+  Uart.println("Done!");
 }
 
 void loop()
 {
-  // Wait for serial commands to execute. @TODO future version should be optimized so arduino isnt parsing a string
-  while (Serial.available() > 0)
+  servoIdle();
+
+  unsigned long now = millis();
+  if (now - controlLastTick >= SERVO_FRAME_TIME)
   {
-    String str = Serial.readString();
-    setCommand(str);
+    // After a blocking move skip the missed ticks instead of running them back to back
+    controlLastTick = (now - controlLastTick >= 2 * SERVO_FRAME_TIME) ? now : controlLastTick + SERVO_FRAME_TIME;
+    controlTick();
   }
+
+  // serialPoll() leaves further text waiting in the UART buffer until this line has run
+  if (commandLineReady)
+  {
+    commandLine[commandLineLength] = '\0';
+    if (commandLineOverflow)
+      DEBUG_PRINT("Command line too long, longest is " + (String)SERIAL_LINE_SIZE);
+    else
+      setCommand(commandLine);
+
+    commandLineLength = 0;
+    commandLineOverflow = false;
+    commandLineReady = false;
+  }
+
+  // One sequenced command per pass, so text lines and packets keep being handled between moves
+  commandPoll();
+
+  // Previews run here, where no blocking move can be part way through
+  previewPoll();
 }
 
-void setCommand(String input)
+/** Background work that runs from loop() and while blocking moves wait */
+void servoIdle()
 {
-  String _servo = getSplitString(input, ',', 0);
-  String _pos = getSplitString(input, ',', 1);
+  serialPoll();
+  poseStoreTick();
+  motionProgramStoreTick();
+  poseLibraryTick();
+}
+
+/** Runs every SERVO_FRAME_TIME from loop(), drives the motion sources that do not block */
+void controlTick()
+{
+  streamTick();
+  motionProgramTick();
+  poseTransitionTick();
+  splineTick();
+  gaitTick();
 
-  int pos = _pos.toInt();
+  // Every source above only staged its frame, the mixer composes and sends them together
+  servoUpdate();
+  stabilityTick();
+}
+
+/** 
+ * Feed received bytes into commandLine until a line is complete, and hand complete
+ * packets to handlePacket(). Only collects bytes, so it is safe to run while a command
+ * is executing. A preview runs it too, so the UART buffer does not overflow, and a packet
+ * that completes then is held until the preview is over
+ */
+void serialPoll()
+{
+  if (serialPacketWaiting && !servoPreviewing)
+  {
+    serialPacketWaiting = false;
+    handlePacket();
+  }
+
+  while (!serialPacketWaiting && Uart.available() > 0)
+  {
+    // Packets start on a line boundary and are taken even while a text line waits to run
+    bool packet = protocolBusy() || ((commandLineReady || commandLineLength == 0) && Uart.peek() == PROTOCOL_SYNC);
+    if (!packet && commandLineReady)
+      break;
+
+    uint8_t c = Uart.read();
+    serialLastByte = millis();
+
+    if (packet)
+    {
+      if (protocolFeed(c))
+      {
+        // Packets can start and stop the sources a preview is running on its shadow state
+        if (servoPreviewing)
+          serialPacketWaiting = true;
+        else
+          handlePacket();
+      }
+    }
+    else if (c == '\n' || c == '\r')
+      commandLineReady = commandLineLength > 0 || commandLineOverflow;
+    else if (commandLineLength < SERIAL_LINE_SIZE)
+      commandLine[commandLineLength++] = c;
+    else
+      commandLineOverflow = true;
+  }
+
+  // Serial monitors set to "No line ending" never send a terminator, so a pause ends the line too
+  if (millis() - serialLastByte >= SERIAL_LINE_TIMEOUT)
+  {
+    if (!commandLineReady && commandLineLength > 0)
+      commandLineReady = true;
+    protocolReset();
+  }
+}
 
-  DEBUG_PRINT("SERVO[" + _servo + "], pos: " + (String)pos);
+/** 
+ * Act on the packet in protocolPayload
+ * Runs from serialPoll(), possibly in the middle of a blocking move, so it must not block
+ */
+void handlePacket()
+{
+  switch (protocolOpcode)
+  {
+  case OP_SETPOINT:
+    if (protocolLength == 2 + SERVO_COUNT)
+      streamReceive(protocolRead16(protocolPayload), protocolPayload + 2);
+    break;
+  case OP_SETPOINT_KEY:
+    streamReceiveKey(protocolPayload, protocolLength);
+    break;
+  case OP_SETPOINT_DELTA:
+    streamReceiveDelta(protocolPayload, protocolLength);
+    break;
+  case OP_COMMAND:
+    commandEnqueue(protocolPayload, protocolLength, false);
+    break;
+  case OP_COMMAND_AT:
+    commandEnqueue(protocolPayload, protocolLength, true);
+    break;
+  case OP_PING:
+    clockPing(protocolPayload, protocolLength);
+    break;
+  case OP_PROGRAM_WRITE:
+    motionProgramWrite(protocolPayload, protocolLength);
+    break;
+  case OP_PROGRAM_STORE:
+    if (protocolLength != 1 || !motionProgramStore(protocolPayload[0]))
+      PROTOCOL_ERRORS++;
+    break;
+  case OP_PROGRAM_RUN:
+    if (protocolLength != 1 || !motionProgramRun(protocolPayload[0]))
+      PROTOCOL_ERRORS++;
+    break;
+  case OP_PROGRAM_STOP:
+    motionProgramStop("stop requested");
+    break;
+  case OP_POSE_CAPTURE:
+    if (protocolLength < 2 || !poseCapture(protocolPayload[0], (const char *)protocolPayload + 1, protocolLength - 1))
+      PROTOCOL_ERRORS++;
+    break;
+  case OP_POSE_GOTO:
+    if (protocolLength != 3 || !poseTransition(protocolPayload[0], protocolRead16(protocolPayload + 1)))
+      PROTOCOL_ERRORS++;
+    break;
+  case OP_SPLINE_WRITE:
+    splineWrite(protocolPayload, protocolLength);
+    break;
+  case OP_SPLINE_RUN:
+    splineRun();
+    break;
+  case OP_SPLINE_STOP:
+    splineStop();
+    break;
+  case OP_PREVIEW:
+    if (!previewRequest(protocolPayload, protocolLength))
+      PROTOCOL_ERRORS++;
+    break;
+  case OP_TWIST:
+    if (protocolLength != 6 || !gaitTwist((int16_t)protocolRead16(protocolPayload),
+                                          (int16_t)protocolRead16(protocolPayload + 2),
+                                          (int16_t)protocolRead16(protocolPayload + 4)))
+      PROTOCOL_ERRORS++;
+    break;
+  default:
+    DEBUG_PRINT("Unknown packet opcode: " + (String)protocolOpcode);
+    break;
+  }
+}
 
-  char servoSwitch = _servo.charAt(0);
-  switch (servoSwitch)
+/**
+ * Run the next sequenced command. One that starts a pose transition or a motion program
+ * stays at the head of the queue until commandStillMoving() is false, so its completion ack
+ * comes when the robot has stopped. A walk goes on until it is stopped and is acked as started
+ */
+void commandPoll()
+{
+  QUEUED_COMMAND *command = commandMoving();
+  if (command)
+  {
+    if (!commandStillMoving(command->text))
+      commandComplete(COMMAND_DONE);
+    return;
+  }
+
+  command = commandNext();
+  if (!command)
+    return;
+
+  // Several commands on a line only stage a frame, which has been moved to on return
+  bool single = !strchr(command->text, ';');
+  if (!setCommand(command->text))
+    commandComplete(COMMAND_FAILED);
+  else if (single && commandStillMoving(command->text))
+    command->moving = true;
+  else if (single && (command->text[0] == 'k' || command->text[0] == 'v'))
+    commandComplete(COMMAND_STARTED);
+  else
+    commandComplete(COMMAND_DONE);
+}
+
+/**
+ * Check whether the move a command started is still going
+ *
+ * @param text    Command text
+ * @returns bool  True while the pose transition or motion program it started runs
+ */
+bool commandStillMoving(const char *text)
+{
+  switch (text[0])
+  {
+  case 'g':
+    return poseTransitionActive;
+  case 'p':
+    return motionRunning;
+  }
+  return false;
+}
+
+/**
+ * Run a command line. Several commands can be given separated by ';', e.g. "t,20;f,10;3,5",
+ * and their moves are then made together as a single frame
+ *
+ * @param input   Command line, split up in place
+ * @returns bool  False if a command was not understood or was out of range
+ */
+bool setCommand(char *input)
+{
+  if (!strchr(input, ';'))
+    return runCommand(input, 0);
+
+  int pose[SERVO_COUNT];
+  for (int i = 0; i < SERVO_COUNT; i++)
+    pose[i] = SERVO_POSITION[i];
+
+  bool succeeded = true;
+  char *command = input;
+  while (command)
+  {
+    char *next = strchr(command, ';');
+    if (next)
+      *next++ = '\0';
+
+    if (*command && !runCommand(command, pose))
+      succeeded = false;
+    command = next;
+  }
+
+  servoSmoothSetFrame(pose, SERVO_WAIT_TIME);
+  servoUpdate(); // Manual offsets set on the line
+  return succeeded;
+}
+
+/**
+ * Run a single "<servo>,<pos>" or "<letter>,<pos>" command
+ *
+ * @param command Command text
+ * @param pose    Moves are put into this pose to be made later, or 0 to move straight away
+ * @returns bool  False if the command was not understood or was out of range
+ */
+bool runCommand(const char *command, int pose[])
+{
+  const char *cursor = command;
+  const char *comma = strchr(command, ',');
+  int pos = 0;
+  if (comma)
+  {
+    cursor = comma + 1;
+    pos = parseInt(&cursor);
+  }
+
+  DEBUG_PRINT(command);
+
+  switch (command[0])
   {
   case 't': // Set all tibias to pos
-    setTibias(pos);
+    if (pose)
+      stageTibias(pose, pos);
+    else
+      setTibias(pos);
     break;
   case 'f': // Set all femurs to pos
-    setFemurs(pos);
+    if (pose)
+      stageFemurs(pose, pos);
+    else
+      setFemurs(pos);
     break;
   case 'r': // Get servo position (from memory)
   { 
+    if (pos < 0 || pos >= SERVO_COUNT)
+      return false;
     int servoPosition = SERVO_POSITION[pos];
-    Serial.println("Position of servo " + (String)pos + " is " + (String)servoPosition);
+    Uart.println("Position of servo " + (String)pos + " is " + (String)servoPosition);
     break;
   }
   case 'm': // Change control mode
@@ -83,21 +392,134 @@ void setCommand(String input)
         _current++;
       }
       _mode = (CONTROL_MODE)_current;
-    } else {
+    } else if (pos <= MANUAL_OFFSET + 1) {
       _mode = (CONTROL_MODE)(pos-1);
     }
 
-    Serial.println("Changed control mode to " + getControlModeName());
+    Uart.println("Changed control mode to " + getControlModeName());
     break;
   }
   case 's': // Adjust the speed
     DEBUG_PRINT("Changing wait time from " + (String)SERVO_WAIT_TIME + " to " + (String)pos);
     SERVO_WAIT_TIME = pos;
     break;    
-  default: // Move a specific servo
-    moveServoFromString(_servo, pos);
+  case 'p': // Run a motion program, pos is the slot. A negative pos stops the running program
+    if (pos < 0)
+    {
+      motionProgramStop("stop requested");
+      break;
+    }
+    return pos <= MOTION_PROGRAM_RAM_SLOT && motionProgramRun(pos);
+  case 'g': // Go to a pose: "g,<index or name>,<duration>"
+  {
+    int index = pos;
+    if (comma && cursor == comma + 1 + strspn(comma + 1, " "))
+      index = poseFind(comma + 1);
+
+    if (pose)
+      return poseGet(index, pose);
+
+    const char *durationText = comma ? strchr(comma + 1, ',') : 0;
+    int duration = POSE_TRANSITION_TIME_DEFAULT;
+    if (durationText)
+    {
+      durationText++;
+      duration = parseInt(&durationText);
+    }
+    return duration >= 0 && poseTransition(index, duration);
+  }
+  case 'c': // Capture the current position as a user pose: "c,<user slot>,<name>"
+  {
+    const char *name = strchr(cursor, ',');
+    return pos >= 0 && name && poseCapture(pos, name + 1, POSE_NAME_SIZE);
+  }
+  case 'w': // Set the weight of a mixer layer: "w,<layer, 0 gait, 1 manual>,<weight 0-255>"
+  {
+    const char *weightText = strchr(cursor, ',');
+    if (pos < 0 || pos >= MIXER_LAYER_COUNT || !weightText)
+      return false;
+    weightText++;
+    int weight = parseInt(&weightText);
+    mixerSetWeight(pos, constrain(weight, 0, MIXER_WEIGHT_FULL));
+    if (!pose)
+      servoUpdate();
+    break;
+  }
+  case 'k': // Walk: "k,<stride forwards>,<stride left>" in mm per step
+  {
+    const char *strideText = strchr(cursor, ',');
+    int strideY = 0;
+    if (strideText)
+    {
+      strideText++;
+      strideY = parseInt(&strideText);
+    }
+    return gaitWalk(pos, strideY);
+  }
+  case 'v': // Walk at a velocity until it is not sent again: "v,<mm/s forwards>,<mm/s left>,<degrees/s anticlockwise>"
+  {
+    int velocity[2] = {0, 0};
+    const char *velocityText = cursor;
+    for (int i = 0; i < 2 && (velocityText = strchr(velocityText, ',')); i++)
+    {
+      velocityText++;
+      velocity[i] = parseInt(&velocityText);
+    }
+    return gaitTwist(pos, velocity[0], velocity[1]);
+  }
+  case 'j': // Change gait without stopping: "j,<0 tripod, 1 wave>,<cycle time ms, optional>"
+  {
+    const char *cycleText = strchr(cursor, ',');
+    int cycleTime = 0;
+    if (pos < GAIT_TRIPOD || pos > GAIT_WAVE)
+      return false;
+    if (cycleText)
+    {
+      cycleText++;
+      cycleTime = parseInt(&cycleText);
+    }
+    gaitSetType((GAIT_TYPE)pos, max(cycleTime, 0));
+    break;
+  }
+  case 'h': // Stop walking
+    gaitStop();
+    break;
+  case 'x': // Report a servo faulty or working again: "x,<servo>,<1 faulty, 0 working>"
+  {
+    const char *faultText = strchr(cursor, ',');
+    if (pos < 0 || pos >= SERVO_COUNT || !faultText)
+      return false;
+    faultText++;
+    gaitSetFault(pos, parseInt(&faultText) != 0);
+    break;
+  }
+  case 'q': // Print a telemetry report
+    telemetryReport(pos);
     break;
+  case 'b': // Change baud rate, pos indexes UART_BAUD_RATES
+    if (pos >= 0 && pos < (int)ARRAY_SIZE(UART_BAUD_RATES))
+    {
+      Uart.println("Changing baud rate to " + (String)UART_BAUD_RATES[pos]);
+      Uart.flush();
+      Uart.begin(UART_BAUD_RATES[pos]);
+      break;
+    }
+    return false;
+  default: // Move a specific servo
+  {
+    // Digits after an optional sign, and nothing else before the ',' or the end
+    const char *digits = command + (command[0] == '-' || command[0] == '+');
+    cursor = command;
+    int servo = parseInt(&cursor);
+    if (*digits < '0' || *digits > '9' || (*cursor != ',' && *cursor != '\0'))
+    {
+      DEBUG_PRINT("Unknown command");
+      return false;
+    }
+    return moveServo(servo, pos, pose);
   }
+  }
+  return true;
 }
 
 String getControlModeName()
@@ -112,17 +534,52 @@ String getControlModeName()
     case ABSOLUTE:
       return "ABSOLUTE";
       break;
+    case MANUAL_OFFSET:
+      return "MANUAL_OFFSET";
+      break;
   }
 }
 
-void moveServoFromString(String _servo, int pos)
+/**
+ * Move a servo according to the control mode
+ *
+ * @param servo   Servo index
+ * @param pos     Position, meaning depends on _mode
+ * @param pose    The target is put into this pose to be moved later, or 0 to move straight away
+ * @returns bool  False if servo is out of range
+ */
+bool moveServo(int servo, int pos, int pose[])
 {
-  int servo = _servo.toInt();
-
   if (servo >= 0 && servo < 18)
   {
     DEBUG_PRINT("Setting servo " + (String)servo + " to position " + (String)pos + ", mode: " + getControlModeName());
 
+    if (_mode == MANUAL_OFFSET)
+    {
+      mixerSetJoint(MIXER_MANUAL, servo, pos * SERVO_INVERTED_STATE[servo]);
+      if (!pose)
+        servoUpdate();
+      return true;
+    }
+
+    if (pose)
+    {
+      int relative = (pose[servo] - SERVO_INITPOS_OFFSET[servo]) / SERVO_INVERTED_STATE[servo];
+      switch(_mode) {
+        case RELATIVE_CURRENT:
+          pose[servo] = SERVO_INITPOS_OFFSET[servo] + (relative + pos) * SERVO_INVERTED_STATE[servo];
+          break;
+        case RELATIVE_INITIAL:
+          pose[servo] = SERVO_INITPOS_OFFSET[servo] + pos * SERVO_INVERTED_STATE[servo];
+          break;
+        case ABSOLUTE:
+        default:
+          pose[servo] = pos;
+          break;
+      }
+      return true;
+    }
+
     switch(_mode) {
       case RELATIVE_CURRENT:
       setSingleServoRelativeToSelf(servo, pos, SERVO_WAIT_TIME);
@@ -131,12 +588,15 @@ void moveServoFromString(String _servo, int pos)
         setSingleServoRelativeToInitial(servo, pos, SERVO_WAIT_TIME);
         break;
       case ABSOLUTE:
+      default:
         servoSmoothSet(servo, pos, SERVO_WAIT_TIME);
         break;
     }
+    return true;
   }
   else
   {
     DEBUG_PRINT("Specificed servo is out of range: " + (String)servo);
+    return false;
   }
 }
\ No newline at end of file
@@ -0,0 +1,44 @@
+/**
+ * ClockSync.h
+ * Ping exchange the host uses to map its clock onto micros(), for OP_COMMAND_AT
+ *
+ * The host sends OP_PING with its own time t0 and notes its time t3 when the OP_PONG
+ * comes back holding t0 and the firmware time t1 at which the ping was taken. Then
+ *   round trip = t3 - t0
+ *   offset     = t1 - (t0 + t3) / 2      (firmware time minus host time)
+ * The pings with the shortest round trip give the best offset. Repeat every few seconds
+ * to follow drift between the two clocks
+ */
+
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+/** Pings answered, reported through telemetry */
+unsigned long CLOCK_PINGS = 0;
+
+/**
+ * Answer an OP_PING
+ *
+ * @param payload uint32 host time, echoed back
+ * @param length  Payload length
+ */
+void clockPing(const uint8_t payload[], uint8_t length)
+{
+  unsigned long now = micros();
+
+  if (length != 4)
+  {
+    PROTOCOL_ERRORS++;
+    return;
+  }
+
+  uint8_t pong[8];
+  for (int i = 0; i < 4; i++)
+    pong[i] = payload[i];
+  protocolWrite32(pong + 4, now);
+
+  CLOCK_PINGS++;
+  protocolSend(OP_PONG, pong, sizeof(pong));
+}
+
+#endif
@@ -0,0 +1,193 @@
+/**
+ * CommandQueue.h
+ * Sequenced commands sent as OP_COMMAND packets, queued so the host can keep several in flight
+ *
+ * Each command is acknowledged twice with OP_COMMAND_ACK: once when it is queued (or
+ * rejected) and once when it has finished. Every ack carries the number of free queue
+ * slots, so the host knows how many more commands it can send without waiting. A command
+ * that starts a move stays at the head of the queue until the move is over, except a walk,
+ * which never ends by itself and is acknowledged as COMMAND_STARTED
+ *
+ * OP_COMMAND_AT commands also carry a start time on the micros() clock (see ClockSync.h).
+ * They still run in order, but the queue holds them until their time comes, and the
+ * completion ack reports how far from that time they actually started
+ */
+
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#define COMMAND_QUEUE_SIZE 8    // Commands held at once, including the one running
+#define COMMAND_MAX_LENGTH 32   // Longest command text
+#define COMMAND_SPIN_TIME 2000  // A timed command this close (us) to its start is waited for in place
+
+typedef enum {
+  COMMAND_QUEUED = 0,   // Accepted, waiting to run
+  COMMAND_DONE = 1,     // Finished
+  COMMAND_FAILED = 2,   // Ran but was not understood or was out of range
+  COMMAND_REJECTED = 3, // Queue full or command too long, not queued
+  COMMAND_STARTED = 4   // Started walking, which goes on until it is stopped
+} COMMAND_STATUS;
+
+typedef struct {
+  uint8_t sequence;
+  bool timed;                 // Start at startAt instead of as soon as possible
+  unsigned long startAt;      // micros()
+  unsigned long startedAt;    // micros() when it was handed out to run
+  bool moving;                // Ran and started a move, completes when the move is over
+  char text[COMMAND_MAX_LENGTH + 1];
+} QUEUED_COMMAND;
+
+/** Queued commands, the oldest (running) one at commandQueueHead */
+QUEUED_COMMAND commandQueue[COMMAND_QUEUE_SIZE];
+uint8_t commandQueueHead = 0;
+uint8_t commandQueueCount = 0;
+
+/** Last command to finish, so a resent command is not run twice */
+bool commandHasCompleted = false;
+uint8_t commandLastCompleted = 0;
+COMMAND_STATUS commandLastStatus = COMMAND_DONE;
+bool commandLastTimed = false;
+long commandLastStartError = 0;
+
+/** Counters reported through telemetry */
+unsigned long COMMANDS_QUEUED = 0;
+unsigned long COMMANDS_REJECTED = 0;
+unsigned long COMMANDS_FAILED = 0;
+long COMMANDS_WORST_START_ERROR = 0;  // us, largest magnitude seen
+
+/**
+ * Send an OP_COMMAND_ACK
+ *
+ * @param sequence    Command sequence number
+ * @param status      COMMAND_STATUS
+ * @param timed       Append startError, for the completion of a timed command
+ * @param startError  Actual minus requested start time, us
+ */
+void commandAck(uint8_t sequence, COMMAND_STATUS status, bool timed = false, long startError = 0)
+{
+  uint8_t payload[7] = {sequence, (uint8_t)status, (uint8_t)(COMMAND_QUEUE_SIZE - commandQueueCount)};
+  protocolWrite32(payload + 3, startError);
+  protocolSend(OP_COMMAND_ACK, payload, timed ? 7 : 3);
+}
+
+/**
+ * Queue a command from an OP_COMMAND or OP_COMMAND_AT payload and acknowledge it
+ *
+ * @param payload uint8 sequence, uint32 start time if timed, then the command text
+ * @param length  Payload length
+ * @param timed   True for OP_COMMAND_AT
+ */
+void commandEnqueue(const uint8_t payload[], uint8_t length, bool timed)
+{
+  uint8_t textStart = timed ? 5 : 1;
+  if (length <= textStart)
+  {
+    PROTOCOL_ERRORS++;
+    return;
+  }
+
+  uint8_t sequence = payload[0];
+
+  // A resent command whose ack was lost, answer again instead of running it twice
+  for (int i = 0; i < commandQueueCount; i++)
+  {
+    if (commandQueue[(commandQueueHead + i) % COMMAND_QUEUE_SIZE].sequence == sequence)
+    {
+      commandAck(sequence, COMMAND_QUEUED);
+      return;
+    }
+  }
+  if (commandHasCompleted && commandLastCompleted == sequence)
+  {
+    commandAck(sequence, commandLastStatus, commandLastTimed, commandLastStartError);
+    return;
+  }
+
+  if (commandQueueCount == COMMAND_QUEUE_SIZE || length - textStart > COMMAND_MAX_LENGTH)
+  {
+    COMMANDS_REJECTED++;
+    commandAck(sequence, COMMAND_REJECTED);
+    return;
+  }
+
+  QUEUED_COMMAND *command = &commandQueue[(commandQueueHead + commandQueueCount) % COMMAND_QUEUE_SIZE];
+  command->sequence = sequence;
+  command->timed = timed;
+  command->moving = false;
+  if (timed)
+    command->startAt = protocolRead32(payload + 1);
+  for (int i = textStart; i < length; i++)
+    command->text[i - textStart] = payload[i];
+  command->text[length - textStart] = '\0';
+
+  commandQueueCount++;
+  COMMANDS_QUEUED++;
+  commandAck(sequence, COMMAND_QUEUED);
+}
+
+/**
+ * Command to run next, or 0 if the queue is empty, the next one is not due yet or the one at
+ * the head has run and is waiting for its move to finish.
+ * Stays queued until commandComplete()
+ */
+QUEUED_COMMAND *commandNext()
+{
+  if (commandQueueCount == 0)
+    return 0;
+
+  QUEUED_COMMAND *command = &commandQueue[commandQueueHead];
+  if (command->moving)
+    return 0;
+  if (command->timed)
+  {
+    // loop() can take a while to come back round, so the last stretch is waited out here
+    long remaining = command->startAt - micros();
+    if (remaining > COMMAND_SPIN_TIME)
+      return 0;
+    while ((long)(command->startAt - micros()) > 0)
+      ;
+  }
+
+  command->startedAt = micros();
+  return command;
+}
+
+/**
+ * Command that has run and is waiting for the move it started to finish
+ *
+ * @returns QUEUED_COMMAND* The command, or 0 if the head of the queue is not waiting
+ */
+QUEUED_COMMAND *commandMoving()
+{
+  if (commandQueueCount == 0 || !commandQueue[commandQueueHead].moving)
+    return 0;
+  return &commandQueue[commandQueueHead];
+}
+
+/**
+ * Remove the command returned by commandNext() and acknowledge its completion
+ *
+ * @param status  COMMAND_DONE, COMMAND_FAILED or COMMAND_STARTED
+ */
+void commandComplete(COMMAND_STATUS status)
+{
+  QUEUED_COMMAND *command = &commandQueue[commandQueueHead];
+
+  commandQueueHead = (commandQueueHead + 1) % COMMAND_QUEUE_SIZE;
+  commandQueueCount--;
+
+  commandHasCompleted = true;
+  commandLastCompleted = command->sequence;
+  commandLastStatus = status;
+  if (status == COMMAND_FAILED)
+    COMMANDS_FAILED++;
+
+  commandLastTimed = command->timed;
+  commandLastStartError = command->timed ? (long)(command->startedAt - command->startAt) : 0;
+  if (abs(commandLastStartError) > abs(COMMANDS_WORST_START_ERROR))
+    COMMANDS_WORST_START_ERROR = commandLastStartError;
+
+  commandAck(commandLastCompleted, commandLastStatus, commandLastTimed, commandLastStartError);
+}
+
+#endif
@@ -6,17 +6,107 @@
 #ifndef CONFIGURATION_H
 #define CONFIGURATION_H
 
+/** Serial settings */
+#define SERIAL_BAUD 115200       // Baud rate at startup, 'b' command switches up to 1Mbaud
+#define SERIAL_LINE_TIMEOUT 20   // A command line without a line ending is complete after this many ms without data
+#define SERIAL_LINE_SIZE 64      // Longest command line, longer lines are dropped
+
+/** Number of servos, 3 per leg */
+#define SERVO_COUNT 18
+
 /** Default servo settings */
-#define SERVO_SETUP_DELAY 200 // Delay between setting up each servo on inital startup
+#define SERVO_FRAME_TIME 20       // Time between frames of a coordinated move, one servo pulse period (50Hz)
+#define SERVO_BOOT_RAMP_TIME 800  // Duration of the ramp from power-on into the standing pose
+#define SERVO_RAMP_MAX_STEP 60    // Most degrees all servos together may move in one frame, limits current draw
 
-/** Use onboard servo driving via Arduino Servo library */
+/** Use onboard servo driving via Arduino Servo library. tools/MotionSimulator.cpp defines it before including this file */
 //#define SERVO_DRIVER_ONBOARD
 /** Use TLC5940 16 Channel PWM driver */
+#ifndef SERVO_DRIVER_ONBOARD
 #define SERVO_DRIVER_TLC5940
+#endif
 
 /** Default delay inbetween each updating the same servo */
 #define SERVO_WAIT_TIME_DEFAULT 40
 
+/** Last commanded pose is kept in EEPROM so a reset can carry on from where the legs are, see PoseStore.h */
+#define POSE_STORE_ADDRESS 0        // First EEPROM byte of the pose ring
+#define POSE_STORE_SLOTS 32         // Records in the ring, spreads EEPROM wear
+#define POSE_STORE_INTERVAL 10000   // Least time between saves while moving
+#define POSE_STORE_IDLE_TIME 1000   // Save once servos have been still this long
+
+/** Stored motion programs, see MotionProgram.h */
+#define MOTION_PROGRAM_ADDRESS 1024 // First EEPROM byte of the program slots, after the pose ring
+
+/** Named poses, see PoseLibrary.h */
+#define POSE_LIBRARY_ADDRESS 1536         // First EEPROM byte of the user poses, after the programs
+#define POSE_USER_SLOTS 16                // User poses kept in EEPROM
+#define POSE_TRANSITION_TIME_DEFAULT 1000 // Transition time when the 'g' command does not give one
+
+/**
+ * Leg geometry, see Kinematics.h. Also used by tools/GuardTables.cpp to build GuardTables.h, regenerate the tables after changing it
+ * At the initial position each coxa points straight out from the side and each femur is level. Relative to
+ * initial (as setTibias() uses), positive angles swing the coxa forwards, lower the femur and fold the tibia in
+ * @TODO Measure on the frame
+ */
+#define LEG_TIBIA_INITIAL_ANGLE 30  // Degrees the tibia points down from the femur line at its initial position
+#define BODY_DEPTH 30               // mm, coxa axes down to the underside of the body
+
+/** Coxa axis positions from the centre of the body in mm, x forwards and y to the left. Same leg order as the servos */
+const int LEG_MOUNT_X[6] = {70, 0, -70, 70, 0, -70};
+const int LEG_MOUNT_Y[6] = {45, 55, 45, -45, -55, -45};
+
+/** Segment lengths of each leg in mm: coxa axis to femur axis, femur axis to tibia axis, tibia axis to foot */
+const int LEG_COXA_LENGTH[6] = {25, 25, 25, 25, 25, 25};
+const int LEG_FEMUR_LENGTH[6] = {50, 50, 50, 50, 50, 50};
+const int LEG_TIBIA_LENGTH[6] = {80, 80, 80, 80, 80, 80};
+
+/** Joint guard soft limits relative to initial, and clearances, see JointGuard.h. Also read by tools/GuardTables.cpp */
+#define GUARD_COXA_MIN -75
+#define GUARD_COXA_MAX 75
+#define GUARD_FEMUR_MIN -60
+#define GUARD_FEMUR_MAX 70
+#define GUARD_TIBIA_MIN -60
+#define GUARD_TIBIA_MAX 110
+#define GUARD_LEG_CLEARANCE 20    // mm kept between the coxa and femur of neighbouring legs, seen from above
+#define GUARD_BODY_CLEARANCE 10   // mm kept between a tibia and the body
+
+/** Walking, see Gait.h */
+#define GAIT_CYCLE_TIME 1000      // ms for every leg to step once with all six legs working
+#define GAIT_SWING_TIME_MIN 250   // Least time a foot spends in the air, gaits that lift one leg at a time slow the cycle to keep it
+#define GAIT_FADE_TIME 500        // Time to blend into the walking stance from the current pose and back out
+#define GAIT_STEP_HEIGHT 20       // mm a foot is lifted
+#define GAIT_BODY_HEIGHT 90       // mm from the coxa axes down to the ground
+#define GAIT_FOOT_REACH 85        // mm out from the coxa axis to the resting foot position
+#define GAIT_STRIDE_MAX 40        // Furthest a foot travels in a step, walking and turning together, mm
+#define GAIT_TURN_MAX 8           // Most the body turns in a step, degrees. The outer coxae swing further than the body turns
+#define GAIT_ACCEL_MAX 40         // Fastest the walking speed changes, mm/s per second
+#define GAIT_TURN_ACCEL_MAX 30    // Fastest the turning speed changes, degrees/s per second
+#define GAIT_TWIST_TIMEOUT 500    // ms a velocity from gaitTwist() lasts without being sent again
+#define GAIT_SHIFT_MAX 15         // Furthest the body is shifted towards the working legs, mm
+#define GAIT_MIN_LEGS 4           // With fewer working legs the robot will not walk
+#define GAIT_TUCK_FEMUR -45       // Where a leg that cannot walk is held out of the way, relative to initial and pulled inside the guard limits
+#define GAIT_TUCK_TIBIA 60
+
+/** Degrees each resting foot is swung forwards from straight out */
+const int GAIT_NEUTRAL_YAW[6] = {45, 0, -45, 45, 0, -45};
+
+/** Static stability, see Stability.h */
+#define STABILITY_MARGIN_MIN 15     // mm the centre of mass should stay inside the feet on the ground
+#define STABILITY_CONTACT_BAND 8    // Feet within this many mm of the lowest foot are taken to be on the ground
+#define STABILITY_PACE_MIN 64       // Slowest the gait and pose transitions go with too little margin, of 256
+#define STABILITY_COM_X 0           // Centre of mass, mm from the centre of the body @TODO Measure with the battery fitted
+#define STABILITY_COM_Y 0
+
+/** Dry runs, see Preview.h */
+#define PREVIEW_TIME_MAX 30000      // Longest motion a preview follows, ms. loop() is held up while a preview runs
+
+/** Inverse kinematics cache, see Kinematics.h. Left out unless a size is given, the AVR cycles it saves are unmeasured */
+#ifndef KINEMATICS_CACHE_SIZE
+#define KINEMATICS_CACHE_SIZE 0     // Entries, a power of two, 9 bytes of SRAM each. 0 solves every target exactly
+#endif
+#define KINEMATICS_CACHE_STEP 2     // mm foot targets are rounded to before solving, about one degree of coxa
+
 /** Servo pin map */
 int SERVO_PIN_MAP[18] = {
     22, // Front  Left  Coxa
@@ -0,0 +1,222 @@
+/**
+ * DeltaCodec.h
+ * Delta encoding for setpoint frames, shared by the firmware and host tools
+ *
+ * Only depends on stdint.h so the host can include it as is.
+ *
+ * A keyframe (OP_SETPOINT_KEY) carries every position:
+ *   uint8 sequence, uint16 time, uint8 position[count]
+ * A delta frame (OP_SETPOINT_DELTA) only carries the joints that changed, relative to
+ * an earlier frame the firmware acknowledged:
+ *   uint8 sequence, uint8 base sequence, uint16 time, changed joint bitmask, deltas
+ * The bitmask has one bit per joint, joint 0 in bit 0 of the first byte. Each delta is a
+ * zigzag encoded varint, so a change of up to +-63 degrees costs a single byte.
+ *
+ * The firmware keeps the last DELTA_HISTORY frames it applied and acknowledges each one
+ * (OP_SETPOINT_ACK). The host encodes against the newest acknowledged frame and falls back
+ * to a keyframe when that is too old, or every keyInterval frames to resync. A keyframe does
+ * not clear the firmware's history, so deltas sent before its acknowledgement comes back
+ * still decode
+ */
+
+#ifndef DELTA_CODEC_H
+#define DELTA_CODEC_H
+
+#include <stdint.h>
+
+/** Most joints a frame can carry */
+#define DELTA_MAX_JOINTS 24
+
+/** Frames kept by each side to encode against */
+#define DELTA_HISTORY 8
+
+/** Map a signed delta onto an unsigned value, small magnitudes first: 0, -1, 1, -2, 2... */
+uint16_t deltaZigzag(int16_t value)
+{
+  return ((uint16_t)value << 1) ^ (uint16_t)(value >> 15);
+}
+
+/** Undo deltaZigzag */
+int16_t deltaUnzigzag(uint16_t value)
+{
+  return (int16_t)(value >> 1) ^ -(int16_t)(value & 1);
+}
+
+/**
+ * Encode the joints of pose that differ from base
+ *
+ * @param base    Reference positions
+ * @param pose    New positions
+ * @param count   Number of joints
+ * @param out     Bitmask and deltas are written here, at most (count + 7) / 8 + 2 * count bytes
+ * @returns int   Bytes written
+ */
+int deltaEncode(const uint8_t *base, const uint8_t *pose, uint8_t count, uint8_t *out)
+{
+  int maskBytes = (count + 7) / 8;
+  int length = maskBytes;
+
+  for (int i = 0; i < maskBytes; i++)
+    out[i] = 0;
+
+  for (int i = 0; i < count; i++)
+  {
+    if (pose[i] == base[i])
+      continue;
+
+    out[i / 8] |= 1 << (i % 8);
+
+    uint16_t value = deltaZigzag((int16_t)pose[i] - base[i]);
+    while (value >= 0x80)
+    {
+      out[length++] = (value & 0x7F) | 0x80;
+      value >>= 7;
+    }
+    out[length++] = value;
+  }
+
+  return length;
+}
+
+/**
+ * Rebuild a pose from base and encoded deltas
+ *
+ * @param base    Reference positions
+ * @param in      Bitmask and deltas
+ * @param length  Bytes available in in
+ * @param count   Number of joints
+ * @param pose    Filled with the new positions, may be the same array as base
+ * @returns int   Bytes used, or -1 if the data is cut short
+ */
+int deltaDecode(const uint8_t *base, const uint8_t *in, int length, uint8_t count, uint8_t *pose)
+{
+  int maskBytes = (count + 7) / 8;
+  int used = maskBytes;
+
+  if (length < maskBytes)
+    return -1;
+
+  for (int i = 0; i < count; i++)
+  {
+    if (!(in[i / 8] & (1 << (i % 8))))
+    {
+      pose[i] = base[i];
+      continue;
+    }
+
+    uint16_t value = 0;
+    uint8_t shift = 0;
+    uint8_t byte;
+    do
+    {
+      if (used >= length || shift > 14)
+        return -1;
+      byte = in[used++];
+      value |= (uint16_t)(byte & 0x7F) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+
+    pose[i] = base[i] + deltaUnzigzag(value);
+  }
+
+  return used;
+}
+
+/** Host side encoder state, see deltaEncoderFrame */
+typedef struct {
+  uint8_t count;                                  // Joints per frame
+  uint16_t keyInterval;                           // Send a keyframe at least this often
+  uint16_t sinceKey;                              // Frames since the last keyframe
+  uint8_t sequence;                               // Sequence of the next frame
+  bool acked;                                     // ackedPose is valid
+  uint8_t ackedSequence;
+  uint8_t ackedPose[DELTA_MAX_JOINTS];
+  uint8_t sentSequence[DELTA_HISTORY];            // Frames waiting for an acknowledgement
+  uint8_t sentPose[DELTA_HISTORY][DELTA_MAX_JOINTS];
+} DELTA_ENCODER;
+
+/**
+ * Start an encoder
+ *
+ * @param encoder     Encoder state
+ * @param count       Joints per frame, at most DELTA_MAX_JOINTS
+ * @param keyInterval Keyframe at least every this many frames
+ */
+void deltaEncoderInit(DELTA_ENCODER *encoder, uint8_t count, uint16_t keyInterval)
+{
+  encoder->count = count;
+  encoder->keyInterval = keyInterval;
+  encoder->sinceKey = 0;
+  encoder->sequence = 0;
+  encoder->acked = false;
+}
+
+/**
+ * Encode the next frame as a keyframe or delta frame payload
+ *
+ * @param encoder Encoder state
+ * @param time    Frame time, ms
+ * @param pose    Positions for this frame
+ * @param out     Payload is written here, at most 4 + (count + 7) / 8 + 2 * count bytes
+ * @param key     Set true for a keyframe (OP_SETPOINT_KEY), false for a delta (OP_SETPOINT_DELTA)
+ * @returns int   Payload length
+ */
+int deltaEncoderFrame(DELTA_ENCODER *encoder, uint16_t time, const uint8_t *pose, uint8_t *out, bool *key)
+{
+  uint8_t sequence = encoder->sequence++;
+  uint8_t slot = sequence % DELTA_HISTORY;
+  int length;
+
+  encoder->sentSequence[slot] = sequence;
+  for (int i = 0; i < encoder->count; i++)
+    encoder->sentPose[slot][i] = pose[i];
+
+  // The firmware only remembers its last DELTA_HISTORY frames
+  *key = !encoder->acked
+      || ++encoder->sinceKey >= encoder->keyInterval
+      || (uint8_t)(sequence - encoder->ackedSequence) >= DELTA_HISTORY;
+
+  out[0] = sequence;
+  if (*key)
+  {
+    encoder->sinceKey = 0;
+    out[1] = time;
+    out[2] = time >> 8;
+    for (int i = 0; i < encoder->count; i++)
+      out[3 + i] = pose[i];
+    length = 3 + encoder->count;
+  }
+  else
+  {
+    out[1] = encoder->ackedSequence;
+    out[2] = time;
+    out[3] = time >> 8;
+    length = 4 + deltaEncode(encoder->ackedPose, pose, encoder->count, out + 4);
+  }
+
+  return length;
+}
+
+/**
+ * Record an acknowledgement (OP_SETPOINT_ACK) from the firmware
+ *
+ * @param encoder   Encoder state
+ * @param sequence  Acknowledged frame
+ */
+void deltaEncoderAck(DELTA_ENCODER *encoder, uint8_t sequence)
+{
+  uint8_t slot = sequence % DELTA_HISTORY;
+  if (encoder->sentSequence[slot] != sequence)
+    return;
+
+  // Acknowledgements can overtake each other, keep the newest
+  if (encoder->acked && (int8_t)(sequence - encoder->ackedSequence) <= 0)
+    return;
+
+  encoder->acked = true;
+  encoder->ackedSequence = sequence;
+  for (int i = 0; i < encoder->count; i++)
+    encoder->ackedPose[i] = encoder->sentPose[slot][i];
+}
+
+#endif
@@ -0,0 +1,721 @@
+/**
+ * Gait.h
+ * Walking. Plans every foot each control tick and writes the joints to the MIXER_GAIT layer
+ *
+ * The plan is made from the legs that can walk. A leg is left out when any of its servos is
+ * disabled in SERVO_ENABLED or has been reported faulty with gaitSetFault(). With all six legs
+ * the robot walks a tripod gait. With fewer it walks a wave gait over the legs it has, lifting
+ * one at a time in GAIT_WAVE_ORDER, holds the legs it cannot use up out of the way and shifts
+ * the body over the middle of the feet that are left. Each foot then spends more of the cycle
+ * on the ground and the cycle is slowed so no swing is quicker than GAIT_SWING_TIME_MIN: the
+ * robot walks slower instead of falling over. The plan is remade as soon as the map changes
+ *
+ * Before a foot lifts the margin the other feet would leave is checked (see Stability.h). If
+ * it is too small a leg that leaves more margin swaps places with it in the cycle, and the
+ * whole gait slows down while the margin stays low.
+ *
+ * The gait and its cycle time can be changed while walking with gaitSetType(). The new plan
+ * is lined up with the old one so the offsets move as little as possible, and from the next
+ * time a foot lands the duty, cycle time and body shift slide across to it over one cycle.
+ * Each leg's offset catches up while its foot is on the ground and drops back while it is in
+ * the air, so no foot is carried further than a step, no swing is hurried and the robot does
+ * not stop. A plan remade because a leg was lost is used straight away.
+ *
+ * Walking is driven by a velocity: forwards, to the left and turning. gaitTwist() sets it
+ * and has to be sent again within GAIT_TWIST_TIMEOUT or the robot stops, gaitWalk() sets it
+ * from a stride and keeps it. Each tick the velocity walked moves towards the one asked for
+ * by at most GAIT_ACCEL_MAX and GAIT_TURN_ACCEL_MAX, and is turned into a stride and turn per
+ * step for the current cycle time, cut down to GAIT_STRIDE_MAX and GAIT_TURN_MAX.
+ *
+ * Feet on the ground move with the body and feet in the air swing from where they lifted to
+ * their next landing point, both worked out again every tick, so a new velocity shows in every
+ * foot straight away without one sliding, and no foot is carried far past its resting place
+ * when the robot sets off or stops
+ */
+
+#ifndef GAIT_H
+#define GAIT_H
+
+#define GAIT_PHASE_ONE 65536UL  // One whole cycle, phases are uint16_t and wrap round
+#define GAIT_TICK_MAX 100       // Most ms one tick advances the gait, after a blocking move it picks up where it was
+
+typedef enum {
+  GAIT_IDLE = 0,    // Not walking, the gait layer is off
+  GAIT_FADE_IN,     // Blending from the commanded pose into the walking stance
+  GAIT_WALKING,
+  GAIT_SETTLING,    // Stride is zero, every foot takes one more step to its resting place
+  GAIT_FADE_OUT     // Blending back to the commanded pose
+} GAIT_STATE;
+
+typedef enum {
+  GAIT_TRIPOD = 0,  // Three legs at a time, used when all six legs can walk
+  GAIT_WAVE         // One leg at a time, always used with fewer than six
+} GAIT_TYPE;
+
+typedef enum {
+  GAIT_BLEND_NONE = 0,
+  GAIT_BLEND_WAITING,   // gaitNext is ready, waiting for a foot to land
+  GAIT_BLEND_RUNNING    // Sliding from gaitFrom to gaitNext
+} GAIT_BLEND;
+
+typedef struct {
+  uint8_t legs;                 // Legs that walk, leg 0 in bit 0
+  uint16_t duty;                // Part of the cycle each foot is on the ground, of GAIT_PHASE_ONE
+  uint16_t offset[LEG_COUNT];   // Added to the gait phase to give the phase of each leg
+  uint16_t cycleTime;           // ms
+  float shiftX;                 // Body shift over the middle of the walking legs, mm
+  float shiftY;
+  float radius;                 // Furthest resting foot from the centre of the body, mm
+} GAIT_PLAN;
+
+/** Order legs lift in with fewer than six: back to front, left side then right */
+const uint8_t GAIT_WAVE_ORDER[LEG_COUNT] = {2, 1, 0, 5, 4, 3};
+
+GAIT_STATE gaitState = GAIT_IDLE;
+GAIT_PLAN gaitPlan;
+
+/** Gait and cycle time asked for, see gaitSetType() */
+GAIT_TYPE gaitType = GAIT_TRIPOD;
+unsigned int gaitCycleTime = GAIT_CYCLE_TIME;
+
+/** Plans gaitPlan is blended between, and how far it has got of GAIT_PHASE_ONE */
+GAIT_BLEND gaitBlend = GAIT_BLEND_NONE;
+GAIT_PLAN gaitFrom;
+GAIT_PLAN gaitNext;
+unsigned long gaitBlendProgress = 0;
+
+/** Servos reported faulty, servo 0 in bit 0 */
+uint32_t gaitFaults = 0;
+/** Faulty and disabled servos gaitPlan was made for */
+uint32_t gaitPlannedFor = 0;
+
+uint16_t gaitPhase = 0;
+unsigned long gaitLastTick = 0;
+int gaitWeight = 0;
+
+/** Velocity asked for and velocity being walked, mm/s forwards and to the left and degrees/s anticlockwise */
+float gaitTargetX = 0;
+float gaitTargetY = 0;
+float gaitTargetTurn = 0;
+float gaitVelocityX = 0;
+float gaitVelocityY = 0;
+float gaitVelocityTurn = 0;
+
+/** Velocity walked as a step: mm the body moves and degrees it turns while a foot is on the ground */
+float gaitStrideX = 0;
+float gaitStrideY = 0;
+float gaitTurn = 0;
+
+/** True while the velocity came from gaitTwist() and has to be refreshed */
+bool gaitTwisting = false;
+unsigned long gaitTwistTime = 0;
+
+/** Where each foot is, and where the feet in the air lifted from */
+float gaitFoot[LEG_COUNT][3];
+float gaitLift[LEG_COUNT][2];
+uint8_t gaitSwinging = 0;   // Legs in the air
+uint8_t gaitSettled = 0;    // Legs put down since settling started
+
+/** Counters reported through telemetry */
+unsigned long GAIT_STEPS = 0;
+unsigned long GAIT_REPLANS = 0;
+unsigned long GAIT_IK_FAILURES = 0;   // Foot positions out of reach, the leg kept its last joint positions
+unsigned long GAIT_TWIST_TIMEOUTS = 0;  // Stops because gaitTwist() was not sent again in time
+unsigned long GAIT_BLENDS = 0;          // Changes of gait or cycle time made while walking
+
+/** Servos the gait cannot use: disabled or reported faulty */
+uint32_t gaitUnusableServos()
+{
+  uint32_t unusable = gaitFaults;
+  for (int i = 0; i < SERVO_COUNT; i++)
+  {
+    if (!SERVO_ENABLED[i])
+      unusable |= (uint32_t)1 << i;
+  }
+  return unusable;
+}
+
+/**
+ * Get the resting position of a foot, before the body shift
+ *
+ * @param leg Leg
+ * @param x   Filled with the position, body frame
+ * @param y
+ */
+void gaitNeutral(int leg, float *x, float *y)
+{
+  float yaw = (90 - GAIT_NEUTRAL_YAW[leg]) * legSide(leg) / KINEMATICS_DEG;
+  *x = LEG_MOUNT_X[leg] + GAIT_FOOT_REACH * cos(yaw);
+  *y = LEG_MOUNT_Y[leg] + GAIT_FOOT_REACH * sin(yaw);
+}
+
+/**
+ * Make a plan for the legs that can walk, with gaitType and gaitCycleTime
+ *
+ * @param unusable  Faulty and disabled servos, servo 0 in bit 0
+ * @param plan      Filled with the plan
+ * @returns bool    False if fewer than GAIT_MIN_LEGS legs can walk
+ */
+bool gaitMakePlan(uint32_t unusable, GAIT_PLAN *plan)
+{
+  gaitPlannedFor = unusable;
+  plan->legs = 0;
+
+  int count = 0;
+  float sumX = 0, sumY = 0;
+  plan->radius = 0;
+  for (int leg = 0; leg < LEG_COUNT; leg++)
+  {
+    if ((unusable >> (leg * 3)) & 0x7)
+      continue;
+
+    float x, y;
+    gaitNeutral(leg, &x, &y);
+    sumX += x;
+    sumY += y;
+    plan->radius = max(plan->radius, sqrt(x * x + y * y));
+    plan->legs |= 1 << leg;
+    count++;
+  }
+
+  if (count < GAIT_MIN_LEGS)
+  {
+    DEBUG_PRINT("Only " + (String)count + " legs can walk");
+    return false;
+  }
+
+  // Towards the middle of the feet, as far as the legs can reach
+  plan->shiftX = sumX / count;
+  plan->shiftY = sumY / count;
+  float shift = sqrt(plan->shiftX * plan->shiftX + plan->shiftY * plan->shiftY);
+  if (shift > GAIT_SHIFT_MAX)
+  {
+    plan->shiftX = plan->shiftX * GAIT_SHIFT_MAX / shift;
+    plan->shiftY = plan->shiftY * GAIT_SHIFT_MAX / shift;
+  }
+  plan->radius += min(shift, (float)GAIT_SHIFT_MAX);
+
+  if (count == LEG_COUNT && gaitType == GAIT_TRIPOD)
+  {
+    // Tripod: front and back left with middle right, then the other three
+    plan->duty = GAIT_PHASE_ONE / 2;
+    for (int leg = 0; leg < LEG_COUNT; leg++)
+      plan->offset[leg] = (leg % 2) ? GAIT_PHASE_ONE / 2 : 0;
+    plan->cycleTime = max(gaitCycleTime, 2U * GAIT_SWING_TIME_MIN);
+  }
+  else
+  {
+    // Wave: each walking leg in turn gets an equal slice of the cycle to swing in
+    plan->duty = GAIT_PHASE_ONE - GAIT_PHASE_ONE / count;
+    int slot = 0;
+    for (int i = 0; i < LEG_COUNT; i++)
+    {
+      int leg = GAIT_WAVE_ORDER[i];
+      if (plan->legs & (1 << leg))
+        plan->offset[leg] = GAIT_PHASE_ONE - GAIT_PHASE_ONE * ++slot / count;
+    }
+    plan->cycleTime = max(gaitCycleTime, (unsigned int)count * GAIT_SWING_TIME_MIN);
+  }
+
+  DEBUG_PRINT("Gait planned for legs 0x" + String(plan->legs, HEX) + ", cycle " + (String)plan->cycleTime + "ms");
+  return true;
+}
+
+/**
+ * Get the resting position of a foot, with the body shift
+ *
+ * @param leg Leg
+ * @param x   Filled with the position, body frame
+ * @param y
+ */
+void gaitRest(int leg, float *x, float *y)
+{
+  gaitNeutral(leg, x, y);
+  *x -= gaitPlan.shiftX;
+  *y -= gaitPlan.shiftY;
+}
+
+/**
+ * Turn a point about the centre of the body
+ *
+ * @param x       Point, body frame
+ * @param y
+ * @param degrees Anticlockwise seen from above
+ */
+void gaitRotate(float *x, float *y, float degrees)
+{
+  float c = cos(degrees / KINEMATICS_DEG);
+  float s = sin(degrees / KINEMATICS_DEG);
+  float rotated = *x * c - *y * s;
+  *y = *x * s + *y * c;
+  *x = rotated;
+}
+
+/** Put every foot at its resting position on the ground */
+void gaitRestFeet()
+{
+  for (int leg = 0; leg < LEG_COUNT; leg++)
+  {
+    gaitRest(leg, &gaitFoot[leg][0], &gaitFoot[leg][1]);
+    gaitFoot[leg][2] = -GAIT_BODY_HEIGHT;
+  }
+  gaitSwinging = 0;
+}
+
+/**
+ * Find a leg to lift in place of one that would leave too little stability margin. Only the
+ * wave gait swaps: its next leg is one short swing away, so the foot kept down is carried only
+ * a little further back. Tripod legs lift in threes and are only slowed, and nothing is swapped
+ * while gaitPlan is being blended
+ *
+ * @param leg     Leg about to lift
+ * @returns int   The next leg due to lift, if lifting it leaves more margin. -1 to lift leg as planned
+ */
+int gaitReorderLift(int leg)
+{
+  if (gaitPlan.duty <= GAIT_PHASE_ONE / 2 || gaitBlend == GAIT_BLEND_RUNNING)
+    return -1;
+
+  uint8_t ground = gaitPlan.legs & ~gaitSwinging & ~(1 << leg);
+  int margin = stabilityMarginFor(ground);
+  if (margin >= STABILITY_MARGIN_MIN)
+    return -1;
+
+  int next = -1;
+  uint16_t nextWait = GAIT_PHASE_ONE - gaitPlan.duty;
+  for (int other = 0; other < LEG_COUNT; other++)
+  {
+    uint16_t wait = gaitPlan.duty - (uint16_t)(gaitPhase + gaitPlan.offset[other]);
+    if ((ground & (1 << other)) && wait > 0 && wait <= nextWait)
+    {
+      next = other;
+      nextWait = wait;
+    }
+  }
+
+  if (next < 0 || stabilityMarginFor((ground | (1 << leg)) & ~(1 << next)) <= margin)
+    return -1;
+  return next;
+}
+
+/**
+ * Move the feet on by part of a cycle
+ *
+ * @param advance Phase to move on by, of GAIT_PHASE_ONE
+ */
+void gaitAdvance(uint16_t advance)
+{
+  gaitPhase += advance;
+
+  for (int leg = 0; leg < LEG_COUNT; leg++)
+  {
+    uint8_t bit = 1 << leg;
+    if (!(gaitPlan.legs & bit))
+      continue;
+
+    // While blending, a leg catches up on the ground and drops back in the air, so no foot
+    // is carried further than a step and no swing is hurried
+    if (gaitBlend == GAIT_BLEND_RUNNING)
+    {
+      int16_t move = gaitNext.offset[leg] - gaitPlan.offset[leg];
+      int16_t most = advance / 2;
+      if (move > 0 && !(gaitSwinging & bit))
+        gaitPlan.offset[leg] += min(move, most);
+      else if (move < 0 && (gaitSwinging & bit))
+        gaitPlan.offset[leg] += max(move, -most);
+    }
+
+    uint16_t phase = gaitPhase + gaitPlan.offset[leg];
+    float *foot = gaitFoot[leg];
+
+    // Lift another leg first if this one would leave too little margin
+    if (phase >= gaitPlan.duty && !(gaitSwinging & bit))
+    {
+      int other = gaitReorderLift(leg);
+      if (other >= 0)
+      {
+        uint16_t offset = gaitPlan.offset[leg];
+        gaitPlan.offset[leg] = gaitPlan.offset[other];
+        gaitPlan.offset[other] = offset;
+        phase = gaitPhase + gaitPlan.offset[leg];
+        STABILITY_REORDERS++;
+      }
+    }
+
+    if (phase < gaitPlan.duty)
+    {
+      if (gaitSwinging & bit)
+      {
+        gaitSwinging &= ~bit;
+        if (gaitStrideX == 0 && gaitStrideY == 0 && gaitTurn == 0)
+          gaitSettled |= bit;
+        GAIT_STEPS++;
+      }
+
+      // On the ground the foot goes back as far as the body goes forwards, and turns the other way
+      float part = (float)advance / gaitPlan.duty;
+      gaitRotate(&foot[0], &foot[1], -gaitTurn * part);
+      foot[0] -= gaitStrideX * part;
+      foot[1] -= gaitStrideY * part;
+      foot[2] = -GAIT_BODY_HEIGHT;
+      continue;
+    }
+
+    if (!(gaitSwinging & bit))
+    {
+      gaitSwinging |= bit;
+      gaitLift[leg][0] = foot[0];
+      gaitLift[leg][1] = foot[1];
+    }
+
+    // In the air the foot heads for half a step on from its resting position
+    float swing = (float)(phase - gaitPlan.duty) / (GAIT_PHASE_ONE - gaitPlan.duty);
+    float x, y;
+    gaitRest(leg, &x, &y);
+    gaitRotate(&x, &y, gaitTurn / 2);
+    x += gaitStrideX / 2;
+    y += gaitStrideY / 2;
+
+    foot[0] = gaitLift[leg][0] + (x - gaitLift[leg][0]) * swing;
+    foot[1] = gaitLift[leg][1] + (y - gaitLift[leg][1]) * swing;
+    foot[2] = -GAIT_BODY_HEIGHT + 4 * GAIT_STEP_HEIGHT * swing * (1 - swing);
+  }
+}
+
+/** Write the joints of every leg to the gait layer */
+void gaitWrite()
+{
+  for (int leg = 0; leg < LEG_COUNT; leg++)
+  {
+    int angles[3];
+    if (gaitPlan.legs & (1 << leg))
+    {
+      if (!legInverseCached(leg, gaitFoot[leg][0], gaitFoot[leg][1], gaitFoot[leg][2], angles))
+      {
+        GAIT_IK_FAILURES++;
+        continue;
+      }
+    }
+    else
+    {
+      // Lift a leg that cannot walk clear of the ground, with whatever joints still work
+      angles[0] = SERVO_POSITION[leg * 3];
+      angles[1] = legServoPosition(leg * 3 + 1, GAIT_TUCK_FEMUR);
+      angles[2] = legServoPosition(leg * 3 + 2, GAIT_TUCK_TIBIA);
+
+      // The tuck is relative to initial, which puts it out of range on some legs
+      guardLeg(leg, angles);
+    }
+
+    for (int j = 0; j < 3; j++)
+    {
+      if (!((gaitPlannedFor >> (leg * 3 + j)) & 1))
+        mixerSetJoint(MIXER_GAIT, leg * 3 + j, angles[j]);
+    }
+  }
+}
+
+/**
+ * Move the velocity walked towards the velocity asked for and work out the step for it
+ *
+ * @param elapsed Time since the last tick, ms
+ */
+void gaitRampStride(unsigned long elapsed)
+{
+  // Slow what was asked for, keeping its direction, until no foot has to travel more than
+  // GAIT_STRIDE_MAX a step and the body turns no more than GAIT_TURN_MAX
+  float seconds = (float)gaitPlan.cycleTime * gaitPlan.duty / GAIT_PHASE_ONE / 1000.0;   // Each foot on the ground
+  float travel = sqrt(gaitTargetX * gaitTargetX + gaitTargetY * gaitTargetY) * seconds +
+                 fabs(gaitTargetTurn) * seconds / KINEMATICS_DEG * gaitPlan.radius;
+  float scale = travel > GAIT_STRIDE_MAX ? GAIT_STRIDE_MAX / travel : 1;
+  float turn = fabs(gaitTargetTurn) * scale * seconds;
+  if (turn > GAIT_TURN_MAX)
+    scale = scale * GAIT_TURN_MAX / turn;
+
+  float step = GAIT_ACCEL_MAX * elapsed / 1000.0;
+  float turnStep = GAIT_TURN_ACCEL_MAX * elapsed / 1000.0;
+  gaitVelocityX += constrain(gaitTargetX * scale - gaitVelocityX, -step, step);
+  gaitVelocityY += constrain(gaitTargetY * scale - gaitVelocityY, -step, step);
+  gaitVelocityTurn += constrain(gaitTargetTurn * scale - gaitVelocityTurn, -turnStep, turnStep);
+
+  gaitStrideX = gaitVelocityX * seconds;
+  gaitStrideY = gaitVelocityY * seconds;
+  gaitTurn = gaitVelocityTurn * seconds;
+}
+
+/**
+ * Start walking in place if not already walking
+ *
+ * @returns bool  False if too few legs can walk
+ */
+bool gaitStart()
+{
+  if (gaitState == GAIT_SETTLING)
+    gaitState = GAIT_WALKING;
+  if (gaitState != GAIT_IDLE && gaitState != GAIT_FADE_OUT)
+    return true;
+
+  gaitBlend = GAIT_BLEND_NONE;
+  if (!gaitMakePlan(gaitUnusableServos(), &gaitPlan))
+    return false;
+
+  gaitRestFeet();
+  gaitVelocityX = 0;
+  gaitVelocityY = 0;
+  gaitVelocityTurn = 0;
+  gaitStrideX = 0;
+  gaitStrideY = 0;
+  gaitTurn = 0;
+  gaitPhase = 0;
+  gaitLastTick = controlMillis();
+  if (gaitState == GAIT_IDLE)
+  {
+    gaitWeight = 0;
+    mixerSetWeight(MIXER_GAIT, 0);
+  }
+  gaitState = GAIT_FADE_IN;
+  return true;
+}
+
+/**
+ * Start walking, or change the stride while walking. Keeps walking until gaitStop()
+ *
+ * @param strideX Step forwards, mm. Cut down to GAIT_STRIDE_MAX
+ * @param strideY Step to the left, mm
+ * @returns bool  False if too few legs can walk
+ */
+bool gaitWalk(float strideX, float strideY)
+{
+  if (!gaitStart())
+    return false;
+
+  float seconds = (float)gaitPlan.cycleTime * gaitPlan.duty / GAIT_PHASE_ONE / 1000.0;
+  gaitTwisting = false;
+  gaitTargetX = strideX / seconds;
+  gaitTargetY = strideY / seconds;
+  gaitTargetTurn = 0;
+  return true;
+}
+
+/**
+ * Start walking, or change the velocity while walking. Has to be sent again within
+ * GAIT_TWIST_TIMEOUT, e.g. by a joystick, or the robot stops
+ *
+ * @param velocityX Forwards, mm/s
+ * @param velocityY To the left, mm/s
+ * @param turn      Anticlockwise seen from above, degrees/s
+ * @returns bool    False if too few legs can walk
+ */
+bool gaitTwist(float velocityX, float velocityY, float turn)
+{
+  if (!gaitStart())
+    return false;
+
+  gaitTwisting = true;
+  gaitTwistTime = controlMillis();
+  gaitTargetX = velocityX;
+  gaitTargetY = velocityY;
+  gaitTargetTurn = turn;
+  return true;
+}
+
+/** Stop walking. The feet are put down at rest first, then the commanded pose is blended back in */
+void gaitStop()
+{
+  gaitTwisting = false;
+  gaitTargetX = 0;
+  gaitTargetY = 0;
+  gaitTargetTurn = 0;
+
+  if (gaitState == GAIT_FADE_IN)
+    gaitState = GAIT_FADE_OUT;
+  else if (gaitState == GAIT_WALKING)
+  {
+    gaitSettled = 0;
+    gaitState = GAIT_SETTLING;
+  }
+}
+
+/**
+ * Mark a servo as faulty or working. A leg with a faulty servo is left out of the gait
+ *
+ * @param servoId Servo
+ * @param faulty  True if it should not be used
+ */
+void gaitSetFault(int servoId, bool faulty)
+{
+  if (faulty)
+    gaitFaults |= (uint32_t)1 << servoId;
+  else
+    gaitFaults &= ~((uint32_t)1 << servoId);
+}
+
+/**
+ * Change the gait and how long a cycle takes. While walking the change is blended in over a
+ * cycle, otherwise it is used the next time the robot walks
+ *
+ * @param type      Gait, a tripod needs all six legs
+ * @param cycleTime ms for every leg to step once, 0 to keep the current one. Slowed to keep
+ *                  every swing at least GAIT_SWING_TIME_MIN
+ */
+void gaitSetType(GAIT_TYPE type, unsigned int cycleTime)
+{
+  gaitType = type;
+  if (cycleTime > 0)
+    gaitCycleTime = cycleTime;
+
+  if (gaitState == GAIT_IDLE || gaitState == GAIT_FADE_OUT)
+    return;
+  if (!gaitMakePlan(gaitPlannedFor, &gaitNext))
+    return;
+
+  // Still fading in, every foot is at rest on the ground
+  if (gaitState == GAIT_FADE_IN)
+  {
+    gaitPlan = gaitNext;
+    gaitRestFeet();
+    gaitBlend = GAIT_BLEND_NONE;
+  }
+  else
+    gaitBlend = GAIT_BLEND_WAITING;
+}
+
+/**
+ * Start blending gaitPlan into gaitNext. The whole of gaitNext is shifted round the cycle, which
+ * changes nothing about it, so that the offsets have as little as possible to move
+ */
+void gaitBlendStart()
+{
+  gaitFrom = gaitPlan;
+
+  uint16_t shift = 0;
+  long best = 0x7FFFFFFFL;
+  for (int candidate = 0; candidate < LEG_COUNT; candidate++)
+  {
+    if (!(gaitNext.legs & (1 << candidate)))
+      continue;
+
+    uint16_t trial = gaitFrom.offset[candidate] - gaitNext.offset[candidate];
+    long moved = 0;
+    for (int leg = 0; leg < LEG_COUNT; leg++)
+    {
+      if (gaitNext.legs & (1 << leg))
+        moved += abs((int16_t)(uint16_t)(gaitNext.offset[leg] + trial - gaitFrom.offset[leg]));
+    }
+    if (moved < best)
+    {
+      best = moved;
+      shift = trial;
+    }
+  }
+  for (int leg = 0; leg < LEG_COUNT; leg++)
+    gaitNext.offset[leg] += shift;
+
+  gaitBlendProgress = 0;
+  gaitBlend = GAIT_BLEND_RUNNING;
+  GAIT_BLENDS++;
+}
+
+/**
+ * Move the duty, cycle time and body shift of gaitPlan on towards gaitNext. The offsets are
+ * moved leg by leg in gaitAdvance()
+ *
+ * @param advance Phase the gait is about to move on by, so the blend slows down with it
+ */
+void gaitBlendStep(uint16_t advance)
+{
+  gaitBlendProgress = min(gaitBlendProgress + advance, GAIT_PHASE_ONE);
+  long progress = gaitBlendProgress;
+  gaitPlan.duty = gaitFrom.duty + ((long)gaitNext.duty - gaitFrom.duty) * progress / (long)GAIT_PHASE_ONE;
+  gaitPlan.cycleTime = gaitFrom.cycleTime + ((long)gaitNext.cycleTime - gaitFrom.cycleTime) * progress / (long)GAIT_PHASE_ONE;
+
+  float part = (float)progress / GAIT_PHASE_ONE;
+  gaitPlan.shiftX = gaitFrom.shiftX + (gaitNext.shiftX - gaitFrom.shiftX) * part;
+  gaitPlan.shiftY = gaitFrom.shiftY + (gaitNext.shiftY - gaitFrom.shiftY) * part;
+  gaitPlan.radius = max(gaitFrom.radius, gaitNext.radius);
+
+  if (gaitBlendProgress < GAIT_PHASE_ONE)
+    return;
+  for (int leg = 0; leg < LEG_COUNT; leg++)
+  {
+    if ((gaitNext.legs & (1 << leg)) && gaitPlan.offset[leg] != gaitNext.offset[leg])
+      return;
+  }
+  gaitPlan = gaitNext;
+  gaitBlend = GAIT_BLEND_NONE;
+}
+
+/** Advance the gait. Call every SERVO_FRAME_TIME */
+void gaitTick()
+{
+  if (gaitState == GAIT_IDLE)
+    return;
+
+  unsigned long elapsed = controlMillis() - gaitLastTick;
+  gaitLastTick += elapsed;
+  if (elapsed > GAIT_TICK_MAX)
+    elapsed = GAIT_TICK_MAX;
+
+  if (gaitTwisting && gaitLastTick - gaitTwistTime > GAIT_TWIST_TIMEOUT)
+  {
+    GAIT_TWIST_TIMEOUTS++;
+    gaitStop();
+  }
+
+  uint32_t unusable = gaitUnusableServos();
+  if (unusable != gaitPlannedFor)
+  {
+    GAIT_REPLANS++;
+    // Joints that became unusable are no longer written and stay where they were last sent
+    gaitBlend = GAIT_BLEND_NONE;
+    if (!gaitMakePlan(unusable, &gaitPlan))
+      gaitState = GAIT_FADE_OUT;
+  }
+
+  switch (gaitState)
+  {
+  case GAIT_FADE_IN:
+    gaitWeight += (int)(MIXER_WEIGHT_FULL * elapsed / GAIT_FADE_TIME);
+    if (gaitWeight >= MIXER_WEIGHT_FULL)
+    {
+      gaitWeight = MIXER_WEIGHT_FULL;
+      gaitState = GAIT_WALKING;
+    }
+    break;
+  case GAIT_WALKING:
+  case GAIT_SETTLING:
+  {
+    uint16_t advance = GAIT_PHASE_ONE * elapsed / gaitPlan.cycleTime * stabilityPace() / STABILITY_PACE_FULL;
+    if (gaitBlend == GAIT_BLEND_RUNNING)
+      gaitBlendStep(advance);
+    gaitRampStride(elapsed);
+
+    uint8_t swinging = gaitSwinging;
+    gaitAdvance(advance);
+    if (gaitBlend == GAIT_BLEND_WAITING && (swinging & ~gaitSwinging))
+      gaitBlendStart();
+    if (gaitState == GAIT_SETTLING && (gaitSettled & gaitPlan.legs) == gaitPlan.legs)
+      gaitState = GAIT_FADE_OUT;
+    break;
+  }
+  case GAIT_FADE_OUT:
+    gaitWeight -= (int)(MIXER_WEIGHT_FULL * elapsed / GAIT_FADE_TIME);
+    if (gaitWeight <= 0)
+    {
+      gaitWeight = 0;
+      mixerSetWeight(MIXER_GAIT, 0);
+      mixerClear(MIXER_GAIT);
+      mixerSetWeight(MIXER_GAIT, MIXER_WEIGHT_FULL);
+      gaitState = GAIT_IDLE;
+      return;
+    }
+    break;
+  default:
+    break;
+  }
+
+  mixerSetWeight(MIXER_GAIT, gaitWeight);
+  gaitWrite();
+}
+
+#endif
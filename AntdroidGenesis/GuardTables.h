@@ -0,0 +1,105 @@
+/**
+ * GuardTables.h
+ * Joint limit and collision tables for JointGuard.h
+ *
+ * Generated by tools/GuardTables.cpp from Configuration.h, do not edit by hand
+ */
+
+#ifndef GUARD_TABLES_H
+#define GUARD_TABLES_H
+
+#ifdef ARDUINO
+#include <avr/pgmspace.h>
+#else
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#endif
+
+#define GUARD_STEP 5   // Degrees per table bin
+#define GUARD_BINS 37
+#define GUARD_COXA_PAIR_COUNT 4
+
+/** Soft limits, absolute {min, max} per servo */
+const uint8_t GUARD_LIMITS[18][2] PROGMEM = {
+    {25, 165},
+    {0, 118},
+    {17, 180},
+    {52, 180},
+    {0, 122},
+    {55, 180},
+    {55, 180},
+    {0, 80},
+    {40, 180},
+    {15, 154},
+    {85, 180},
+    {0, 125},
+    {48, 180},
+    {110, 180},
+    {0, 158},
+    {20, 170},
+    {110, 180},
+    {0, 155}
+};
+
+/** Neighbouring coxae, {front, rear} */
+const uint8_t GUARD_COXA_PAIRS[GUARD_COXA_PAIR_COUNT][2] PROGMEM = {{0, 3}, {3, 6}, {9, 12}, {12, 15}};
+
+/** Range of the rear coxa for each bin of the front coxa, one table per pair */
+const uint8_t GUARD_COXA_TABLE[4][GUARD_BINS][2] PROGMEM = {
+    {{52, 180}, {52, 180}, {52, 180}, {52, 180}, {52, 180}, {52, 65}, {52, 91}, {52, 105},
+     {52, 115}, {52, 122}, {52, 129}, {52, 134}, {52, 139}, {52, 143}, {52, 147}, {52, 151},
+     {52, 156}, {52, 162}, {52, 168}, {52, 174}, {52, 179}, {52, 180}, {52, 180}, {52, 180},
+     {52, 180}, {52, 180}, {52, 180}, {52, 180}, {52, 180}, {52, 180}, {52, 180}, {52, 180},
+     {52, 180}, {52, 180}, {52, 180}, {52, 180}, {52, 180}},
+    {{55, 180}, {55, 180}, {55, 180}, {55, 180}, {55, 180}, {55, 180}, {55, 180}, {55, 180},
+     {55, 180}, {55, 180}, {55, 75}, {55, 90}, {55, 100}, {55, 108}, {55, 115}, {55, 120},
+     {55, 125}, {55, 129}, {55, 133}, {55, 137}, {55, 142}, {55, 148}, {55, 154}, {55, 160},
+     {55, 165}, {55, 170}, {55, 174}, {55, 177}, {55, 180}, {55, 180}, {55, 180}, {55, 180},
+     {55, 180}, {55, 180}, {55, 180}, {55, 180}, {55, 180}},
+    {{48, 180}, {48, 180}, {48, 180}, {48, 180}, {48, 180}, {48, 180}, {48, 180}, {48, 180},
+     {49, 180}, {51, 180}, {53, 180}, {55, 180}, {58, 180}, {62, 180}, {66, 180}, {70, 180},
+     {75, 180}, {81, 180}, {87, 180}, {93, 180}, {98, 180}, {102, 180}, {106, 180}, {110, 180},
+     {115, 180}, {120, 180}, {126, 180}, {133, 180}, {143, 180}, {155, 180}, {177, 180}, {48, 180},
+     {48, 180}, {48, 180}, {48, 180}, {48, 180}, {48, 180}},
+    {{30, 170}, {30, 170}, {30, 170}, {30, 170}, {30, 170}, {30, 170}, {30, 170}, {30, 170},
+     {30, 170}, {30, 170}, {30, 170}, {30, 170}, {31, 170}, {31, 170}, {32, 170}, {33, 170},
+     {34, 170}, {36, 170}, {37, 170}, {39, 170}, {42, 170}, {44, 170}, {47, 170}, {51, 170},
+     {55, 170}, {59, 170}, {64, 170}, {70, 170}, {76, 170}, {82, 170}, {87, 170}, {91, 170},
+     {95, 170}, {99, 170}, {104, 170}, {109, 170}, {110, 170}}
+};
+
+/** Range of the tibia for each bin of the femur, one table per leg */
+const uint8_t GUARD_ENVELOPE_TABLE[6][GUARD_BINS][2] PROGMEM = {
+    {{17, 180}, {17, 180}, {17, 180}, {17, 180}, {17, 180}, {17, 180}, {17, 180}, {17, 180},
+     {17, 180}, {17, 180}, {17, 180}, {17, 180}, {17, 180}, {17, 180}, {17, 180}, {17, 180},
+     {17, 180}, {17, 178}, {17, 176}, {17, 174}, {17, 172}, {17, 168}, {17, 165}, {17, 161},
+     {17, 157}, {17, 152}, {17, 148}, {17, 143}, {17, 137}, {17, 132}, {17, 126}, {17, 120},
+     {17, 114}, {17, 108}, {17, 101}, {17, 180}, {17, 180}},
+    {{55, 180}, {55, 180}, {55, 180}, {55, 180}, {55, 180}, {55, 180}, {55, 180}, {55, 180},
+     {55, 180}, {55, 180}, {55, 180}, {55, 180}, {55, 180}, {55, 180}, {55, 180}, {55, 180},
+     {55, 180}, {55, 180}, {55, 180}, {55, 180}, {55, 180}, {55, 180}, {55, 180}, {55, 180},
+     {55, 180}, {55, 180}, {55, 180}, {55, 180}, {55, 180}, {55, 174}, {55, 169}, {55, 163},
+     {55, 157}, {55, 151}, {55, 144}, {55, 180}, {55, 180}},
+    {{40, 180}, {40, 180}, {40, 180}, {40, 180}, {40, 180}, {40, 180}, {40, 180}, {40, 180},
+     {40, 180}, {40, 180}, {40, 180}, {40, 180}, {40, 180}, {40, 180}, {40, 180}, {40, 180},
+     {40, 180}, {40, 177}, {40, 172}, {40, 168}, {40, 163}, {40, 157}, {40, 152}, {40, 146},
+     {40, 140}, {40, 133}, {40, 127}, {40, 180}, {40, 180}, {40, 180}, {40, 180}, {40, 180},
+     {40, 180}, {40, 180}, {40, 180}, {40, 180}, {40, 180}},
+    {{0, 125}, {0, 125}, {0, 125}, {0, 125}, {0, 125}, {0, 125}, {40, 125}, {33, 125},
+     {27, 125}, {20, 125}, {15, 125}, {9, 125}, {3, 125}, {0, 125}, {0, 125}, {0, 125},
+     {0, 125}, {0, 125}, {0, 125}, {0, 125}, {0, 125}, {0, 125}, {0, 125}, {0, 125},
+     {0, 125}, {0, 125}, {0, 125}, {0, 125}, {0, 125}, {0, 125}, {0, 125}, {0, 125},
+     {0, 125}, {0, 125}, {0, 125}, {0, 125}, {0, 125}},
+    {{0, 158}, {0, 158}, {0, 158}, {0, 158}, {0, 158}, {0, 158}, {0, 158}, {0, 158},
+     {0, 158}, {0, 158}, {0, 158}, {73, 158}, {66, 158}, {60, 158}, {53, 158}, {48, 158},
+     {42, 158}, {36, 158}, {31, 158}, {26, 158}, {22, 158}, {18, 158}, {13, 158}, {10, 158},
+     {6, 158}, {3, 158}, {1, 158}, {0, 158}, {0, 158}, {0, 158}, {0, 158}, {0, 158},
+     {0, 158}, {0, 158}, {0, 158}, {0, 158}, {0, 158}},
+    {{0, 155}, {0, 155}, {0, 155}, {0, 155}, {0, 155}, {0, 155}, {0, 155}, {0, 155},
+     {0, 155}, {0, 155}, {0, 155}, {70, 155}, {63, 155}, {57, 155}, {50, 155}, {45, 155},
+     {39, 155}, {33, 155}, {28, 155}, {23, 155}, {19, 155}, {15, 155}, {10, 155}, {7, 155},
+     {3, 155}, {0, 155}, {0, 155}, {0, 155}, {0, 155}, {0, 155}, {0, 155}, {0, 155},
+     {0, 155}, {0, 155}, {0, 155}, {0, 155}, {0, 155}}
+};
+
+#endif
@@ -7,29 +7,42 @@
 #define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
 
 /**
- * Split a string by delimiter and get index
- * Originally from https://stackoverflow.com/questions/9072320/split-string-into-string-array
+ * Parse a decimal integer in place, like String::toInt() but without copying the text
+ * Leading spaces and a sign are accepted, parsing stops at the first other character
  * 
- * @param data      The input string
- * @param separator The delimiter
- * @param index     Index of portion of string to return
- * @returns String  String containing data || blank
+ * @param cursor  Text to parse, moved past the number
+ * @returns int   Parsed value, 0 if there are no digits
  */
-String getSplitString(String data, char separator, int index)
+int parseInt(const char **cursor)
 {
-  int found = 0;
-  int strIndex[] = {0, -1};
-  int maxIndex = data.length() - 1;
+  const char *p = *cursor;
+  bool negative = false;
+  int value = 0;
 
-  for (int i = 0; i <= maxIndex && found <= index; i++)
-  {
-    if (data.charAt(i) == separator || i == maxIndex)
-    {
-      found++;
-      strIndex[0] = strIndex[1] + 1;
-      strIndex[1] = (i == maxIndex) ? i + 1 : i;
-    }
-  }
+  while (*p == ' ')
+    p++;
+  if (*p == '-' || *p == '+')
+    negative = *p++ == '-';
+  while (*p >= '0' && *p <= '9')
+    value = value * 10 + (*p++ - '0');
 
-  return found > index ? data.substring(strIndex[0], strIndex[1]) : "";
+  *cursor = p;
+  return negative ? -value : value;
+}
+
+/**
+ * Add a byte to a CRC-8 (polynomial 0x07). Start a new checksum with 0xFF
+ * so erased (all 0xFF) and zeroed memory never check out as valid
+ * 
+ * @param crc     Checksum so far
+ * @param data    Byte to add
+ * @returns uint8_t Updated checksum
+ */
+uint8_t crc8Update(uint8_t crc, uint8_t data)
+{
+  crc ^= data;
+  for (int i = 0; i < 8; i++)
+    crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+
+  return crc;
 }
@@ -0,0 +1,111 @@
+/**
+ * JointGuard.h
+ * Keeps each composed frame inside the joint soft limits and clear of collisions before it reaches the servos
+ *
+ * The tables in GuardTables.h are built offline from the leg geometry by tools/GuardTables.cpp,
+ * so checking a frame is a fixed number of table lookups. Joints are pulled back into range
+ * rather than the frame being dropped, and every clamp is counted
+ */
+
+#ifndef JOINT_GUARD_H
+#define JOINT_GUARD_H
+
+#include "GuardTables.h"
+
+/** Counters reported through telemetry */
+unsigned long GUARD_LIMIT_CLAMPS = 0;     // Joints past their soft limit
+unsigned long GUARD_COXA_CLAMPS = 0;      // Coxae that would have hit the leg in front
+unsigned long GUARD_ENVELOPE_CLAMPS = 0;  // Tibias that would have hit the body
+
+/** Joints clamped in the last frame, servo 0 in bit 0 */
+uint32_t guardClamped = 0;
+
+/**
+ * Pull one joint of a frame into a range. Disabled servos are left alone
+ *
+ * @param frame   Absolute position of each servo
+ * @param servoId Joint
+ * @param range   {min, max} in flash
+ * @returns bool  True if the joint was moved
+ */
+bool guardClamp(int frame[], int servoId, const uint8_t range[2])
+{
+  if (!SERVO_ENABLED[servoId])
+    return false;
+
+  int low = pgm_read_byte(&range[0]);
+  int high = pgm_read_byte(&range[1]);
+  if (frame[servoId] < low)
+    frame[servoId] = low;
+  else if (frame[servoId] > high)
+    frame[servoId] = high;
+  else
+    return false;
+  return true;
+}
+
+/**
+ * Pull a pose for one leg inside its soft limits and its tibia clear of the body, as
+ * guardFrame() would. For poses worked out ahead, so they are not clamped on every frame
+ *
+ * @param leg     Leg
+ * @param angles  Absolute coxa, femur and tibia position, changed in place
+ */
+void guardLeg(int leg, int angles[3])
+{
+  for (int j = 0; j < 3; j++)
+  {
+    int servoId = leg * 3 + j;
+    if (SERVO_ENABLED[servoId])
+      angles[j] = constrain(angles[j], pgm_read_byte(&GUARD_LIMITS[servoId][0]), pgm_read_byte(&GUARD_LIMITS[servoId][1]));
+  }
+
+  if (SERVO_ENABLED[leg * 3 + 2])
+  {
+    const uint8_t *range = GUARD_ENVELOPE_TABLE[leg][constrain(angles[1], 0, 180) / GUARD_STEP];
+    angles[2] = constrain(angles[2], pgm_read_byte(&range[0]), pgm_read_byte(&range[1]));
+  }
+}
+
+/**
+ * Check a frame and clamp any joint that breaks a limit. Called from mixerCompose()
+ *
+ * @param frame Absolute position of each servo, 0 to 180
+ */
+void guardFrame(int frame[])
+{
+  guardClamped = 0;
+  for (int i = 0; i < SERVO_COUNT; i++)
+  {
+    if (guardClamp(frame, i, GUARD_LIMITS[i]))
+    {
+      GUARD_LIMIT_CLAMPS++;
+      guardClamped |= (uint32_t)1 << i;
+    }
+  }
+
+  // The front leg of each pair wins, the rear coxa makes room
+  for (int p = 0; p < GUARD_COXA_PAIR_COUNT; p++)
+  {
+    int front = pgm_read_byte(&GUARD_COXA_PAIRS[p][0]);
+    int rear = pgm_read_byte(&GUARD_COXA_PAIRS[p][1]);
+    if (guardClamp(frame, rear, GUARD_COXA_TABLE[p][frame[front] / GUARD_STEP]))
+    {
+      GUARD_COXA_CLAMPS++;
+      guardClamped |= (uint32_t)1 << rear;
+    }
+  }
+
+  // Coxa, femur, tibia for each leg
+  for (int leg = 0; leg < SERVO_COUNT / 3; leg++)
+  {
+    int femur = leg * 3 + 1;
+    if (guardClamp(frame, femur + 1, GUARD_ENVELOPE_TABLE[leg][frame[femur] / GUARD_STEP]))
+    {
+      GUARD_ENVELOPE_CLAMPS++;
+      guardClamped |= (uint32_t)1 << (femur + 1);
+    }
+  }
+}
+
+#endif
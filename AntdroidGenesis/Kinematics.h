@@ -0,0 +1,273 @@
+/**
+ * Kinematics.h
+ * Leg geometry: where the joints have to be to put a foot at a point
+ *
+ * Positions are in mm in the body frame: from the centre of the body at the height of the
+ * coxa axes, x forwards, y to the left and z up. Joint conventions and lengths are the ones
+ * in Configuration.h, each leg with its own mount point and segment lengths. Only needs
+ * Configuration.h, so host tools can include it too (tools/KinematicsCheck.cpp checks it)
+ *
+ * legInverse() works in float and is used to plan. legForward() works in integers, with a
+ * sine table in flash, so it is cheap enough to run on every leg every control tick.
+ * legInverseCached() can put a small direct mapped cache in front of legInverse(): in a
+ * steady gait the same rounded foot targets come round every cycle. The rounding moves joints
+ * by a degree or two, so it is only built in when KINEMATICS_CACHE_SIZE is set, see
+ * tools/IkCacheBenchmark.cpp
+ */
+
+#ifndef KINEMATICS_H
+#define KINEMATICS_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <avr/pgmspace.h>
+#else
+#define PROGMEM
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#endif
+
+#define LEG_COUNT 6
+
+#define KINEMATICS_DEG (180.0 / M_PI)
+
+#define KINEMATICS_ONE_SHIFT 14   // Sine table values are sin * (1 << KINEMATICS_ONE_SHIFT)
+#define KINEMATICS_FRACTION_BITS 4  // Fractions of a mm kept between the leg plane and the body frame
+
+/** Solved foot target, angles are from the initial positions so they fit in a byte */
+typedef struct {
+  int16_t x;          // Target in KINEMATICS_CACHE_STEP
+  int16_t y;
+  int8_t z;
+  uint8_t leg : 7;    // Leg + 1, 0 for an empty slot
+  uint8_t reachable : 1;
+  int8_t angles[3];
+} KINEMATICS_CACHE_ENTRY;
+
+#if KINEMATICS_CACHE_SIZE > 0
+KINEMATICS_CACHE_ENTRY kinematicsCache[KINEMATICS_CACHE_SIZE];
+#endif
+
+/** Counters reported through telemetry */
+unsigned long KINEMATICS_CACHE_HITS = 0;
+unsigned long KINEMATICS_CACHE_MISSES = 0;
+
+/** sin of 0 to 90 degrees */
+const int16_t KINEMATICS_SINE[91] PROGMEM = {
+    0, 286, 572, 857, 1143, 1428, 1713, 1997, 2280, 2563,
+    2845, 3126, 3406, 3686, 3964, 4240, 4516, 4790, 5063, 5334,
+    5604, 5872, 6138, 6402, 6664, 6924, 7182, 7438, 7692, 7943,
+    8192, 8438, 8682, 8923, 9162, 9397, 9630, 9860, 10087, 10311,
+    10531, 10749, 10963, 11174, 11381, 11585, 11786, 11982, 12176, 12365,
+    12551, 12733, 12911, 13085, 13255, 13421, 13583, 13741, 13894, 14044,
+    14189, 14330, 14466, 14598, 14726, 14849, 14968, 15082, 15191, 15296,
+    15396, 15491, 15582, 15668, 15749, 15826, 15897, 15964, 16026, 16083,
+    16135, 16182, 16225, 16262, 16294, 16322, 16344, 16362, 16374, 16382,
+    16384};
+
+/**
+ * Get the sine of a whole number of degrees
+ *
+ * @param degrees Any angle
+ * @returns long  sin * (1 << KINEMATICS_ONE_SHIFT)
+ */
+long kinematicsSin(int degrees)
+{
+  degrees %= 360;
+  if (degrees < 0)
+    degrees += 360;
+
+  if (degrees <= 90)
+    return (int16_t)pgm_read_word(&KINEMATICS_SINE[degrees]);
+  if (degrees <= 180)
+    return (int16_t)pgm_read_word(&KINEMATICS_SINE[180 - degrees]);
+  if (degrees <= 270)
+    return -(int16_t)pgm_read_word(&KINEMATICS_SINE[degrees - 180]);
+  return -(int16_t)pgm_read_word(&KINEMATICS_SINE[360 - degrees]);
+}
+
+/** Cosine to go with kinematicsSin() */
+long kinematicsCos(int degrees)
+{
+  return kinematicsSin(degrees + 90);
+}
+
+/** 1 for legs on the left, -1 for legs on the right */
+int legSide(int leg)
+{
+  return leg < LEG_COUNT / 2 ? 1 : -1;
+}
+
+/**
+ * Turn an angle relative to initial into the absolute position of a servo
+ *
+ * @param servoId Servo
+ * @param angle   Degrees relative to initial
+ */
+int legServoPosition(int servoId, float angle)
+{
+  return SERVO_INITPOS_OFFSET[servoId] + (int)lround(angle) * SERVO_INVERTED_STATE[servoId];
+}
+
+/**
+ * Get the angle of a servo relative to initial
+ *
+ * @param servoId Servo
+ * @param pos     Absolute position
+ */
+int legJointAngle(int servoId, int pos)
+{
+  return (pos - SERVO_INITPOS_OFFSET[servoId]) * SERVO_INVERTED_STATE[servoId];
+}
+
+/**
+ * Work out where a foot is from its joint positions
+ *
+ * @param leg       Leg, in servo order
+ * @param positions Absolute position of every servo, e.g. SERVO_OUTPUT
+ * @param foot      Filled with the foot position in mm, body frame
+ */
+void legForward(int leg, const int positions[], int foot[3])
+{
+  int coxa = legJointAngle(leg * 3, positions[leg * 3]);
+  int femur = legJointAngle(leg * 3 + 1, positions[leg * 3 + 1]);
+  int tibia = femur + LEG_TIBIA_INITIAL_ANGLE + legJointAngle(leg * 3 + 2, positions[leg * 3 + 2]);
+  long half = 1L << (KINEMATICS_ONE_SHIFT - 1);
+
+  // In the plane of the leg: out from the coxa axis, and down
+  long out = ((long)LEG_COXA_LENGTH[leg] << KINEMATICS_ONE_SHIFT) +
+             LEG_FEMUR_LENGTH[leg] * kinematicsCos(femur) + LEG_TIBIA_LENGTH[leg] * kinematicsCos(tibia);
+  long down = LEG_FEMUR_LENGTH[leg] * kinematicsSin(femur) + LEG_TIBIA_LENGTH[leg] * kinematicsSin(tibia);
+
+  // Keep KINEMATICS_FRACTION_BITS of out through the yaw so the foot is only rounded once
+  int fine = KINEMATICS_ONE_SHIFT - KINEMATICS_FRACTION_BITS;
+  long outFine = (out + (1L << (fine - 1))) >> fine;
+  int shift = KINEMATICS_ONE_SHIFT + KINEMATICS_FRACTION_BITS;
+
+  int yaw = legSide(leg) * (90 - coxa);
+  foot[0] = LEG_MOUNT_X[leg] + (int)((outFine * kinematicsCos(yaw) + (1L << (shift - 1))) >> shift);
+  foot[1] = LEG_MOUNT_Y[leg] + (int)((outFine * kinematicsSin(yaw) + (1L << (shift - 1))) >> shift);
+  foot[2] = -(int)((down + half) >> KINEMATICS_ONE_SHIFT);
+}
+
+/**
+ * Work out the joint positions that put a foot at a point
+ *
+ * @param leg     Leg, in servo order
+ * @param x       Foot position, body frame
+ * @param y
+ * @param z
+ * @param angles  Filled with the absolute coxa, femur and tibia positions
+ * @returns bool  False if the point is out of reach, angles is left alone
+ */
+bool legInverse(int leg, float x, float y, float z, int angles[3])
+{
+  float dx = x - LEG_MOUNT_X[leg];
+  float dy = y - LEG_MOUNT_Y[leg];
+
+  // Seen from above the coxa points straight at the foot. Straight out is 0, forwards is positive
+  float yaw = atan2(dy, dx) * KINEMATICS_DEG;
+  float coxa = 90 - yaw * legSide(leg);
+  if (coxa > 180)
+    coxa -= 360;
+
+  // Femur and tibia in the plane of the leg, knee above the line from femur axis to foot
+  float out = sqrt(dx * dx + dy * dy) - LEG_COXA_LENGTH[leg];
+  float down = -z;
+  float reach = sqrt(out * out + down * down);
+  if (reach >= LEG_FEMUR_LENGTH[leg] + LEG_TIBIA_LENGTH[leg] || reach <= abs(LEG_FEMUR_LENGTH[leg] - LEG_TIBIA_LENGTH[leg]))
+    return false;
+
+  float femurToReach = acos((LEG_FEMUR_LENGTH[leg] * LEG_FEMUR_LENGTH[leg] + reach * reach - LEG_TIBIA_LENGTH[leg] * LEG_TIBIA_LENGTH[leg]) /
+                            (2.0 * LEG_FEMUR_LENGTH[leg] * reach));
+  float knee = acos((LEG_FEMUR_LENGTH[leg] * LEG_FEMUR_LENGTH[leg] + LEG_TIBIA_LENGTH[leg] * LEG_TIBIA_LENGTH[leg] - reach * reach) /
+                    (2.0 * LEG_FEMUR_LENGTH[leg] * LEG_TIBIA_LENGTH[leg]));
+
+  float femur = (atan2(down, out) - femurToReach) * KINEMATICS_DEG;
+  float tibia = 180 - knee * KINEMATICS_DEG - LEG_TIBIA_INITIAL_ANGLE;
+
+  angles[0] = legServoPosition(leg * 3, coxa);
+  angles[1] = legServoPosition(leg * 3 + 1, femur);
+  angles[2] = legServoPosition(leg * 3 + 2, tibia);
+  return true;
+}
+
+/**
+ * Solve a foot target through the cache
+ *
+ * Targets are rounded to KINEMATICS_CACHE_STEP and the rounded point is solved, so an entry
+ * gives the same answer whichever target filled it. Points out of reach are cached too. A
+ * miss replaces whatever was in the slot. With KINEMATICS_CACHE_SIZE 0 every target is
+ * solved as it is, and counted as a miss
+ *
+ * @param leg     Leg, in servo order
+ * @param x       Foot position, body frame
+ * @param y
+ * @param z
+ * @param angles  Filled with the absolute coxa, femur and tibia positions
+ * @returns bool  False if the point is out of reach, angles is left alone
+ */
+bool legInverseCached(int leg, float x, float y, float z, int angles[3])
+{
+#if KINEMATICS_CACHE_SIZE == 0
+  KINEMATICS_CACHE_MISSES++;
+  return legInverse(leg, x, y, z, angles);
+#else
+  long qx = lround(x / KINEMATICS_CACHE_STEP);
+  long qy = lround(y / KINEMATICS_CACHE_STEP);
+  long qz = lround(z / KINEMATICS_CACHE_STEP);
+  float rx = (float)qx * KINEMATICS_CACHE_STEP;
+  float ry = (float)qy * KINEMATICS_CACHE_STEP;
+  float rz = (float)qz * KINEMATICS_CACHE_STEP;
+
+  // Too far away to fit in an entry
+  if (qx != (int16_t)qx || qy != (int16_t)qy || qz != (int8_t)qz)
+  {
+    KINEMATICS_CACHE_MISSES++;
+    return legInverse(leg, rx, ry, rz, angles);
+  }
+
+  uint8_t slot = (uint8_t)(qx * 7 + qy * 13 + qz * 3 + leg * 19) & (KINEMATICS_CACHE_SIZE - 1);
+  KINEMATICS_CACHE_ENTRY *entry = &kinematicsCache[slot];
+  if (entry->leg == leg + 1 && entry->x == qx && entry->y == qy && entry->z == qz)
+  {
+    KINEMATICS_CACHE_HITS++;
+    if (!entry->reachable)
+      return false;
+    for (int j = 0; j < 3; j++)
+      angles[j] = SERVO_INITPOS_OFFSET[leg * 3 + j] + entry->angles[j];
+    return true;
+  }
+
+  KINEMATICS_CACHE_MISSES++;
+  int solved[3];
+  bool reachable = legInverse(leg, rx, ry, rz, solved);
+  for (int j = 0; j < 3 && reachable; j++)
+  {
+    // A joint too far from initial to fit in a byte is solved again each time
+    if (solved[j] - SERVO_INITPOS_OFFSET[leg * 3 + j] != (int8_t)(solved[j] - SERVO_INITPOS_OFFSET[leg * 3 + j]))
+    {
+      memcpy(angles, solved, sizeof(solved));
+      return true;
+    }
+  }
+
+  entry->leg = leg + 1;
+  entry->x = qx;
+  entry->y = qy;
+  entry->z = qz;
+  entry->reachable = reachable;
+  if (!reachable)
+    return false;
+  for (int j = 0; j < 3; j++)
+  {
+    entry->angles[j] = solved[j] - SERVO_INITPOS_OFFSET[leg * 3 + j];
+    angles[j] = solved[j];
+  }
+  return true;
+#endif
+}
+
+#endif
@@ -0,0 +1,147 @@
+/**
+ * Mixer.h
+ * Layers combined with the commanded positions to give what the servos are actually sent
+ *
+ * SERVO_POSITION is the base every existing move writes, the blocking moves and the pose
+ * transition, motion program, spline and setpoint stream alike. Each layer holds a value for
+ * some of the joints and a weight. servoUpdate() starts from the base, applies the layers in
+ * MIXER_LAYER_ID order, clamps the result, passes it through the joint guard into
+ * SERVO_OUTPUT and sends it as one frame. An offset layer adds its weighted value, an
+ * override layer blends the joint towards its value by its weight.
+ *
+ * Behaviours write their own layer and leave the others alone, so a manual offset survives
+ * a setTibias() and a gait can be faded in and out by its weight
+ */
+
+#ifndef MIXER_H
+#define MIXER_H
+
+#define MIXER_WEIGHT_FULL 255
+
+/** Layers, applied in this order */
+typedef enum {
+  MIXER_GAIT = 0,   // Leg positions from the gait planner
+  MIXER_MANUAL,     // Per joint offsets set by hand, see the MANUAL_OFFSET control mode
+  MIXER_LAYER_COUNT
+} MIXER_LAYER_ID;
+
+typedef enum {
+  MIXER_OFFSET = 0, // Add value * weight to the joint
+  MIXER_OVERRIDE    // Blend the joint towards value by weight
+} MIXER_MODE;
+
+typedef struct {
+  int value[SERVO_COUNT];
+  uint32_t mask;      // Joints this layer acts on, servo 0 in bit 0
+  uint8_t weight;     // 0 to MIXER_WEIGHT_FULL
+  MIXER_MODE mode;
+} MIXER_LAYER;
+
+MIXER_LAYER mixerLayers[MIXER_LAYER_COUNT] = {
+    {{0}, 0, MIXER_WEIGHT_FULL, MIXER_OVERRIDE},  // MIXER_GAIT
+    {{0}, 0, MIXER_WEIGHT_FULL, MIXER_OFFSET}     // MIXER_MANUAL
+};
+
+/**
+ * Set one joint of a layer. Goes out with the next servoUpdate()
+ *
+ * @param layer   MIXER_LAYER_ID
+ * @param servoId Joint
+ * @param value   Offset or target position, depending on the layer mode
+ */
+void mixerSetJoint(uint8_t layer, int servoId, int value)
+{
+  uint32_t bit = (uint32_t)1 << servoId;
+  MIXER_LAYER *target = &mixerLayers[layer];
+
+  if ((target->mask & bit) && target->value[servoId] == value)
+    return;
+
+  target->value[servoId] = value;
+  target->mask |= bit;
+  SERVO_DIRTY |= bit;
+}
+
+/**
+ * Stop a layer acting on any joint
+ *
+ * @param layer   MIXER_LAYER_ID
+ */
+void mixerClear(uint8_t layer)
+{
+  SERVO_DIRTY |= mixerLayers[layer].mask;
+  mixerLayers[layer].mask = 0;
+}
+
+/**
+ * Change how strongly a layer applies
+ *
+ * @param layer   MIXER_LAYER_ID
+ * @param weight  0 to MIXER_WEIGHT_FULL
+ */
+void mixerSetWeight(uint8_t layer, uint8_t weight)
+{
+  if (mixerLayers[layer].weight == weight)
+    return;
+
+  mixerLayers[layer].weight = weight;
+  SERVO_DIRTY |= mixerLayers[layer].mask;
+}
+
+/**
+ * Work out the output of every joint, guard the frame (see JointGuard.h) and write the
+ * joints that changed to the driver. Called from servoUpdate(). Nothing is written during a preview
+ *
+ * Every joint is composed, not only the dirty ones, so a joint the guard pulled in last
+ * frame goes back to where it was commanded once it is clear again
+ *
+ * @returns uint32_t  Joints whose output changed
+ */
+uint32_t mixerCompose()
+{
+  int frame[SERVO_COUNT];
+
+  for (int i = 0; i < SERVO_COUNT; i++)
+  {
+    uint32_t bit = (uint32_t)1 << i;
+    if (!SERVO_ENABLED[i])
+    {
+      frame[i] = SERVO_OUTPUT[i];
+      continue;
+    }
+
+    int output = SERVO_POSITION[i];
+    for (int k = 0; k < MIXER_LAYER_COUNT; k++)
+    {
+      MIXER_LAYER *layer = &mixerLayers[k];
+      if (!(layer->mask & bit))
+        continue;
+
+      if (layer->mode == MIXER_OVERRIDE)
+        output += (long)(layer->value[i] - output) * layer->weight / MIXER_WEIGHT_FULL;
+      else
+        output += (long)layer->value[i] * layer->weight / MIXER_WEIGHT_FULL;
+    }
+    if (output < 0 || output > 180)
+      servoClipped |= bit;
+    frame[i] = constrain(output, 0, 180);
+  }
+
+  guardFrame(frame);
+
+  uint32_t changed = 0;
+  for (int i = 0; i < SERVO_COUNT; i++)
+  {
+    if (frame[i] != SERVO_OUTPUT[i])
+    {
+      SERVO_OUTPUT[i] = frame[i];
+      if (!servoPreviewing)
+        servoWriteOutput(i, frame[i]);
+      changed |= (uint32_t)1 << i;
+    }
+  }
+
+  return changed;
+}
+
+#endif
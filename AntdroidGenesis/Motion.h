@@ -6,6 +6,10 @@
 #ifndef MOTION_H
 #define MOTION_H
 
+/** Servos moved together by setFemurs and setTibias */
+const int FEMUR_SERVOS[6] = {1, 4, 7, 10, 13, 16};
+const int TIBIA_SERVOS[6] = {2, 5, 8, 11, 14, 17};
+
 /** Last set position of all femures */
 int allFemureLastPos = 0;
 
@@ -19,7 +23,7 @@ void setFemurs(int startPos, int targetPos)
 {
   DEBUG_PRINT("setFemurs(" + (String)targetPos + ")");
 
-  servoSetRelativeToInital(new int[6]{1, 4, 7, 10, 13, 16}, 6, startPos, targetPos);
+  servoSetRelativeToInital(FEMUR_SERVOS, 6, startPos, targetPos);
   allFemureLastPos = targetPos;
 }
 
@@ -47,7 +51,7 @@ void setTibias(int startPos, int targetPos)
 {
   DEBUG_PRINT("setTibias(" + (String)targetPos + ")");
 
-  servoSetRelativeToInital(new int[6]{2, 5, 8, 11, 14, 17}, 6, startPos, targetPos);
+  servoSetRelativeToInital(TIBIA_SERVOS, 6, startPos, targetPos);
   allTibiaLastPos = targetPos;
 }
 
@@ -62,4 +66,42 @@ void setTibias(int targetPos)
   setTibias(allTibiaLastPos, targetPos);
 }
 
+/**
+ * Put a group of servos at the same position relative to initial into a pose, without moving them
+ * 
+ * @param pose      Pose to change
+ * @param servos    Servos to set
+ * @param count     Number of servos
+ * @param targetPos Position relative to initial
+ */
+void stageRelativeToInitial(int pose[], const int servos[], int count, int targetPos)
+{
+  for (int i = 0; i < count; i++)
+    pose[servos[i]] = SERVO_INITPOS_OFFSET[servos[i]] + targetPos * SERVO_INVERTED_STATE[servos[i]];
+}
+
+/**
+ * setFemurs for a pose that is moved later as one frame
+ * 
+ * @param pose      Pose to change
+ * @param targetPos Position relative to initial
+ */
+void stageFemurs(int pose[], int targetPos)
+{
+  stageRelativeToInitial(pose, FEMUR_SERVOS, 6, targetPos);
+  allFemureLastPos = targetPos;
+}
+
+/**
+ * setTibias for a pose that is moved later as one frame
+ * 
+ * @param pose      Pose to change
+ * @param targetPos Position relative to initial
+ */
+void stageTibias(int pose[], int targetPos)
+{
+  stageRelativeToInitial(pose, TIBIA_SERVOS, 6, targetPos);
+  allTibiaLastPos = targetPos;
+}
+
 #endif
\ No newline at end of file
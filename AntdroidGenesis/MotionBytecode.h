@@ -0,0 +1,61 @@
+/**
+ * MotionBytecode.h
+ * Instruction set of the motion programs run by MotionProgram.h
+ *
+ * Only depends on stdint.h so the host assembler (tools/MotionAssembler.cpp) can include it.
+ *
+ * A program is a list of instructions, each an opcode byte followed by its operands.
+ * Multi-byte operands are little endian. Positions are set on the selected group of
+ * servos first and only move when an MP_MOVE follows, so a move is always coordinated
+ */
+
+#ifndef MOTION_BYTECODE_H
+#define MOTION_BYTECODE_H
+
+#include <stdint.h>
+
+#define MOTION_PROGRAM_SLOTS 8                          // Programs kept in EEPROM, slots 0 to 7
+#define MOTION_PROGRAM_RAM_SLOT MOTION_PROGRAM_SLOTS    // Slot number of the program uploaded into RAM
+#define MOTION_PROGRAM_SIZE 64                          // Bytes per program
+#define MOTION_MAX_DEPTH 4                              // Deepest nesting of MP_LOOP, and of MP_CALL
+
+typedef enum {
+  MP_END = 0x00,          // End of program, or return from MP_CALL
+  MP_GROUP = 0x01,        // uint8 mask[3]: select servos, servo 0 in bit 0 of the first byte
+  MP_SET = 0x02,          // int8 position relative to initial for every selected servo
+  MP_SET_ABSOLUTE = 0x03, // uint8 absolute position for every selected servo
+  MP_MOVE = 0x04,         // uint16 duration (ms): move every servo to its set position
+  MP_WAIT = 0x05,         // uint16 time (ms)
+  MP_LOOP = 0x06,         // uint8 count, 0 for ever: repeat up to the matching MP_NEXT
+  MP_NEXT = 0x07,
+  MP_CALL = 0x08          // uint8 slot: run another program, then carry on
+} MOTION_OPCODE;
+
+/**
+ * Get the operand size of an instruction
+ *
+ * @param opcode  MOTION_OPCODE
+ * @returns int   Operand bytes after the opcode, -1 if the opcode is unknown
+ */
+int motionOperandSize(uint8_t opcode)
+{
+  switch (opcode)
+  {
+  case MP_END:
+  case MP_NEXT:
+    return 0;
+  case MP_SET:
+  case MP_SET_ABSOLUTE:
+  case MP_LOOP:
+  case MP_CALL:
+    return 1;
+  case MP_MOVE:
+  case MP_WAIT:
+    return 2;
+  case MP_GROUP:
+    return 3;
+  }
+  return -1;
+}
+
+#endif
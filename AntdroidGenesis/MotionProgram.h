@@ -0,0 +1,321 @@
+/**
+ * MotionProgram.h
+ * Runs motion programs (see MotionBytecode.h) without blocking, one instruction per control tick
+ *
+ * Programs live in EEPROM slots so new motions need no reflash. A program is uploaded over
+ * serial into the RAM slot, can be run from there straight away, and is copied into an
+ * EEPROM slot in the background when it should be kept
+ */
+
+#ifndef MOTION_PROGRAM_H
+#define MOTION_PROGRAM_H
+
+#include <avr/eeprom.h>
+
+typedef enum {
+  MOTION_READY = 0,   // Next tick runs the next instruction
+  MOTION_MOVING,      // An MP_MOVE is in progress
+  MOTION_WAITING      // An MP_WAIT is in progress
+} MOTION_STATE;
+
+typedef struct {
+  uint8_t slot;
+  uint8_t pc;
+} MOTION_RETURN;
+
+typedef struct {
+  uint8_t pc;         // First instruction of the loop body
+  uint8_t remaining;  // Passes left, 0 for ever
+} MOTION_LOOP;
+
+/** Program uploaded with OP_PROGRAM_WRITE */
+uint8_t motionProgramRam[MOTION_PROGRAM_SIZE];
+
+/** Running program */
+bool motionRunning = false;
+MOTION_STATE motionState = MOTION_READY;
+uint8_t motionSlot = 0;
+uint8_t motionPc = 0;
+MOTION_RETURN motionCalls[MOTION_MAX_DEPTH];
+uint8_t motionCallDepth = 0;
+MOTION_LOOP motionLoops[MOTION_MAX_DEPTH];
+uint8_t motionLoopDepth = 0;
+
+/** Servos MP_SET acts on, servo 0 in bit 0 */
+uint32_t motionGroup = 0;
+
+/** Positions set for the next MP_MOVE, and the move in progress */
+int motionTarget[SERVO_COUNT];
+int motionFrom[SERVO_COUNT];
+unsigned long motionStarted = 0;
+uint16_t motionDuration = 0;
+
+/** EEPROM slot the RAM program is being copied to. Nothing is being copied once motionStoreIndex reaches MOTION_PROGRAM_SIZE */
+uint8_t motionStoreSlot = 0;
+int motionStoreIndex = MOTION_PROGRAM_SIZE;
+
+/** Counters reported through telemetry */
+unsigned long MOTION_PROGRAMS_RUN = 0;
+unsigned long MOTION_PROGRAM_ERRORS = 0;  // Programs stopped by a bad instruction, slot or nesting
+
+/**
+ * Get the EEPROM address of a program slot
+ *
+ * @param slot  Slot index, below MOTION_PROGRAM_SLOTS
+ */
+uint8_t *motionSlotAddress(uint8_t slot)
+{
+  return (uint8_t *)(MOTION_PROGRAM_ADDRESS + slot * MOTION_PROGRAM_SIZE);
+}
+
+/**
+ * Stop the running program, leaving the servos where they are
+ *
+ * @param reason  Printed when debugging
+ */
+void motionProgramStop(const char *reason)
+{
+  if (motionRunning)
+    DEBUG_PRINT("Motion program stopped: " + (String)reason);
+  motionRunning = false;
+}
+
+/** Stop a program that has gone wrong */
+void motionProgramFault(const char *reason)
+{
+  MOTION_PROGRAM_ERRORS++;
+  motionProgramStop(reason);
+}
+
+/**
+ * Start a program from the beginning. Takes over from any program already running
+ *
+ * @param slot    EEPROM slot, or MOTION_PROGRAM_RAM_SLOT
+ * @returns bool  False if slot does not exist
+ */
+bool motionProgramRun(uint8_t slot)
+{
+  if (slot > MOTION_PROGRAM_RAM_SLOT)
+    return false;
+
+  motionRunning = true;
+  motionState = MOTION_READY;
+  motionSlot = slot;
+  motionPc = 0;
+  motionCallDepth = 0;
+  motionLoopDepth = 0;
+  motionGroup = 0;
+  for (int i = 0; i < SERVO_COUNT; i++)
+    motionTarget[i] = SERVO_POSITION[i];
+
+  MOTION_PROGRAMS_RUN++;
+  return true;
+}
+
+/**
+ * Read the next instruction of the running program
+ *
+ * @param operands  Filled with the operand bytes
+ * @returns int     Opcode, or -1 if it is unknown or runs off the end of the program
+ */
+int motionFetch(uint8_t operands[])
+{
+  uint8_t instruction[4];
+  uint8_t length = 1;
+
+  for (uint8_t i = 0; i < length; i++)
+  {
+    if (motionPc >= MOTION_PROGRAM_SIZE)
+      return -1;
+
+    if (motionSlot == MOTION_PROGRAM_RAM_SLOT)
+      instruction[i] = motionProgramRam[motionPc++];
+    else
+      instruction[i] = eeprom_read_byte(motionSlotAddress(motionSlot) + motionPc++);
+
+    if (i == 0)
+    {
+      int operandSize = motionOperandSize(instruction[0]);
+      if (operandSize < 0)
+        return -1;
+      length += operandSize;
+    }
+  }
+
+  for (uint8_t i = 1; i < length; i++)
+    operands[i - 1] = instruction[i];
+  return instruction[0];
+}
+
+/** Run one instruction of the running program */
+void motionStep()
+{
+  uint8_t operands[3];
+  int opcode = motionFetch(operands);
+
+  switch (opcode)
+  {
+  case MP_END:
+    if (motionCallDepth == 0)
+    {
+      motionProgramStop("end");
+      break;
+    }
+    motionCallDepth--;
+    motionSlot = motionCalls[motionCallDepth].slot;
+    motionPc = motionCalls[motionCallDepth].pc;
+    break;
+  case MP_GROUP:
+    motionGroup = operands[0] | ((uint32_t)operands[1] << 8) | ((uint32_t)operands[2] << 16);
+    break;
+  case MP_SET:
+  case MP_SET_ABSOLUTE:
+    for (int i = 0; i < SERVO_COUNT; i++)
+    {
+      if (!(motionGroup & ((uint32_t)1 << i)))
+        continue;
+      if (opcode == MP_SET)
+        motionTarget[i] = SERVO_INITPOS_OFFSET[i] + (int8_t)operands[0] * SERVO_INVERTED_STATE[i];
+      else
+        motionTarget[i] = operands[0];
+    }
+    break;
+  case MP_MOVE:
+    for (int i = 0; i < SERVO_COUNT; i++)
+      motionFrom[i] = SERVO_POSITION[i];
+    motionDuration = operands[0] | (operands[1] << 8);
+    motionStarted = controlMillis();
+    motionState = MOTION_MOVING;
+    break;
+  case MP_WAIT:
+    motionDuration = operands[0] | (operands[1] << 8);
+    motionStarted = controlMillis();
+    motionState = MOTION_WAITING;
+    break;
+  case MP_LOOP:
+    if (motionLoopDepth == MOTION_MAX_DEPTH)
+    {
+      motionProgramFault("loops nested too deep");
+      break;
+    }
+    motionLoops[motionLoopDepth].pc = motionPc;
+    motionLoops[motionLoopDepth].remaining = operands[0];
+    motionLoopDepth++;
+    break;
+  case MP_NEXT:
+  {
+    if (motionLoopDepth == 0)
+    {
+      motionProgramFault("next without loop");
+      break;
+    }
+    MOTION_LOOP *loop = &motionLoops[motionLoopDepth - 1];
+    if (loop->remaining == 0 || --loop->remaining > 0)
+      motionPc = loop->pc;
+    else
+      motionLoopDepth--;
+    break;
+  }
+  case MP_CALL:
+    if (motionCallDepth == MOTION_MAX_DEPTH || operands[0] > MOTION_PROGRAM_RAM_SLOT)
+    {
+      motionProgramFault("bad call");
+      break;
+    }
+    motionCalls[motionCallDepth].slot = motionSlot;
+    motionCalls[motionCallDepth].pc = motionPc;
+    motionCallDepth++;
+    motionSlot = operands[0];
+    motionPc = 0;
+    break;
+  default:
+    motionProgramFault("bad instruction");
+    break;
+  }
+}
+
+/** Advance the running program. Call every SERVO_FRAME_TIME */
+void motionProgramTick()
+{
+  if (!motionRunning)
+    return;
+
+  unsigned long elapsed = controlMillis() - motionStarted;
+  switch (motionState)
+  {
+  case MOTION_MOVING:
+  {
+    int pose[SERVO_COUNT];
+    bool done = elapsed >= motionDuration;
+    for (int i = 0; i < SERVO_COUNT; i++)
+      pose[i] = done ? motionTarget[i] : motionFrom[i] + (int)((long)(motionTarget[i] - motionFrom[i]) * (long)elapsed / motionDuration);
+    servoSetFrame(pose, false);
+
+    if (done)
+      motionState = MOTION_READY;
+    break;
+  }
+  case MOTION_WAITING:
+    if (elapsed >= motionDuration)
+      motionState = MOTION_READY;
+    break;
+  case MOTION_READY:
+    motionStep();
+    // A move starts in the tick that reads it
+    if (motionState == MOTION_MOVING)
+      motionProgramTick();
+    break;
+  }
+}
+
+/**
+ * Write part of the RAM program from an OP_PROGRAM_WRITE payload
+ *
+ * @param payload uint8 offset followed by program bytes
+ * @param length  Payload length
+ */
+void motionProgramWrite(const uint8_t payload[], uint8_t length)
+{
+  if (length < 1 || payload[0] + length - 1 > MOTION_PROGRAM_SIZE)
+  {
+    PROTOCOL_ERRORS++;
+    return;
+  }
+
+  if (motionRunning && motionSlot == MOTION_PROGRAM_RAM_SLOT)
+    motionProgramStop("overwritten");
+
+  for (int i = 1; i < length; i++)
+    motionProgramRam[payload[0] + i - 1] = payload[i];
+}
+
+/**
+ * Start copying the RAM program into an EEPROM slot
+ *
+ * @param slot    EEPROM slot
+ * @returns bool  False if slot does not exist
+ */
+bool motionProgramStore(uint8_t slot)
+{
+  if (slot >= MOTION_PROGRAM_SLOTS)
+    return false;
+
+  if (motionRunning && motionSlot == slot)
+    motionProgramStop("overwritten");
+
+  motionStoreSlot = slot;
+  motionStoreIndex = 0;
+  return true;
+}
+
+/** Copy a byte of a program being stored. Call often, never waits on the EEPROM */
+void motionProgramStoreTick()
+{
+  if (motionStoreIndex >= MOTION_PROGRAM_SIZE || !eeprom_is_ready())
+    return;
+
+  eeprom_update_byte(motionSlotAddress(motionStoreSlot) + motionStoreIndex, motionProgramRam[motionStoreIndex]);
+  motionStoreIndex++;
+}
+
+#endif
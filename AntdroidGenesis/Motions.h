@@ -45,4 +45,42 @@ void MotionPushUpright()
   setFemurs(25);
 }
 
+/** 
+ * Fill pose with the standing position MotionPrepareForStand and MotionPushUpright end in
+ * 
+ * @param pose  Absolute position for each servo
+ */
+void MotionGetStandPose(int pose[])
+{
+  for (int i = 0; i < SERVO_COUNT; i++)
+    pose[i] = SERVO_INITPOS_OFFSET[i];
+
+  // Outer coxae out
+  pose[0] = 150;
+  pose[6] = 100;
+  pose[15] = 130;
+
+  for (int leg = 0; leg < 6; leg++)
+  {
+    int femur = leg * 3 + 1;
+    int tibia = leg * 3 + 2;
+
+    pose[tibia] = SERVO_INITPOS_OFFSET[tibia] + 40 * SERVO_INVERTED_STATE[tibia];
+    pose[femur] = SERVO_INITPOS_OFFSET[femur] + 25 * SERVO_INVERTED_STATE[femur];
+  }
+}
+
+/** Go from the power-on pose to standing in a single coordinated ramp */
+void MotionBootToStand()
+{
+  DEBUG_PRINT("MotionBootToStand()");
+
+  int pose[SERVO_COUNT];
+  MotionGetStandPose(pose);
+  servoRampToPose(pose, SERVO_BOOT_RAMP_TIME);
+
+  allTibiaLastPos = 40;
+  allFemureLastPos = 25;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,269 @@
+/**
+ * PoseLibrary.h
+ * Named whole-body poses, and smooth transitions between them
+ *
+ * Poses 0 to POSE_DEFAULT_COUNT - 1 are built in and kept in flash, relative to
+ * SERVO_INITPOS_OFFSET so they follow the calibration the same way setTibias() does.
+ * The last of them, "stand", is MotionGetStandPose() so the two cannot drift apart.
+ * The POSE_USER_SLOTS poses after them are captured from SERVO_POSITION and kept in
+ * EEPROM. A transition moves every joint together on the control tick, easing in and
+ * out, and never blocks. It slows down while the stability margin is low, see Stability.h
+ */
+
+#ifndef POSE_LIBRARY_H
+#define POSE_LIBRARY_H
+
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+
+#define POSE_NAME_SIZE 8
+
+/** User pose record layout: name, one angle per servo, CRC */
+#define POSE_RECORD_SIZE (POSE_NAME_SIZE + SERVO_COUNT + 1)
+
+typedef struct {
+  char name[POSE_NAME_SIZE];
+  int8_t position[SERVO_COUNT];   // Relative to initial, like setTibias()
+} DEFAULT_POSE;
+
+/** Built in poses, the ones Motions.h moves through */
+const DEFAULT_POSE POSE_DEFAULTS[] PROGMEM = {
+    // Power-on position
+    {"init", {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}},
+    // MotionTouchGround, legs on the ground but too low to stand
+    {"crouch", {0, 20, 15, 0, 20, 15, 0, 20, 15, 0, 20, 15, 0, 20, 15, 0, 20, 15}},
+    // MotionPrepareForStand then MotionUpTouchGround, outer legs out and ready to push
+    {"ready", {60, 20, 40, 0, 20, 40, -30, 20, 40, 0, 20, 40, 0, 20, 40, -35, 20, 40}}
+};
+
+/** Built in pose after POSE_DEFAULTS taken from MotionGetStandPose() */
+#define POSE_STAND (int)ARRAY_SIZE(POSE_DEFAULTS)
+#define POSE_STAND_NAME "stand"
+
+#define POSE_DEFAULT_COUNT (POSE_STAND + 1)
+#define POSE_COUNT (POSE_DEFAULT_COUNT + POSE_USER_SLOTS)
+
+/** User pose being written. Nothing is being written once poseWriteIndex reaches POSE_RECORD_SIZE */
+uint8_t poseRecord[POSE_RECORD_SIZE];
+uint8_t poseWriteSlot = 0;
+int poseWriteIndex = POSE_RECORD_SIZE;
+
+/** Transition in progress */
+bool poseTransitionActive = false;
+int poseFrom[SERVO_COUNT];
+int poseTo[SERVO_COUNT];
+unsigned long poseTransitionLastTick = 0;
+unsigned long poseTransitionElapsed = 0;  // ms of the transition done, runs slow while stabilityPace() is low
+uint16_t poseTransitionDuration = 0;
+
+/**
+ * Get the EEPROM address of a user pose slot
+ *
+ * @param slot  User slot, below POSE_USER_SLOTS
+ */
+uint8_t *poseSlotAddress(uint8_t slot)
+{
+  return (uint8_t *)(POSE_LIBRARY_ADDRESS + slot * POSE_RECORD_SIZE);
+}
+
+/**
+ * Read a user pose record and check it
+ *
+ * @param slot    User slot
+ * @param record  Filled with the record bytes
+ * @returns bool  True if the slot holds a valid pose
+ */
+bool poseReadRecord(uint8_t slot, uint8_t record[])
+{
+  eeprom_read_block(record, poseSlotAddress(slot), POSE_RECORD_SIZE);
+
+  uint8_t crc = 0xFF;
+  for (int i = 0; i < POSE_RECORD_SIZE - 1; i++)
+    crc = crc8Update(crc, record[i]);
+  return crc == record[POSE_RECORD_SIZE - 1];
+}
+
+/**
+ * Get a pose
+ *
+ * @param index   Pose index, user poses follow the defaults
+ * @param pose    Filled with the absolute position of each servo
+ * @returns bool  False if index is out of range or the user slot is empty
+ */
+bool poseGet(int index, int pose[])
+{
+  if (index < 0 || index >= POSE_COUNT)
+    return false;
+
+  if (index == POSE_STAND)
+  {
+    MotionGetStandPose(pose);
+    return true;
+  }
+  if (index < POSE_DEFAULT_COUNT)
+  {
+    for (int i = 0; i < SERVO_COUNT; i++)
+    {
+      int8_t relative = pgm_read_byte(&POSE_DEFAULTS[index].position[i]);
+      pose[i] = SERVO_INITPOS_OFFSET[i] + relative * SERVO_INVERTED_STATE[i];
+    }
+    return true;
+  }
+
+  uint8_t record[POSE_RECORD_SIZE];
+  if (!poseReadRecord(index - POSE_DEFAULT_COUNT, record))
+    return false;
+
+  for (int i = 0; i < SERVO_COUNT; i++)
+    pose[i] = record[POSE_NAME_SIZE + i];
+  return true;
+}
+
+/**
+ * Get the name of a pose
+ *
+ * @param index   Pose index
+ * @param name    Filled with the name, at least POSE_NAME_SIZE + 1 chars
+ * @returns bool  False if there is no such pose
+ */
+bool poseGetName(int index, char name[])
+{
+  if (index < 0 || index >= POSE_COUNT)
+    return false;
+
+  if (index == POSE_STAND)
+    strncpy(name, POSE_STAND_NAME, POSE_NAME_SIZE);
+  else if (index < POSE_DEFAULT_COUNT)
+    memcpy_P(name, POSE_DEFAULTS[index].name, POSE_NAME_SIZE);
+  else
+  {
+    uint8_t record[POSE_RECORD_SIZE];
+    if (!poseReadRecord(index - POSE_DEFAULT_COUNT, record))
+      return false;
+    memcpy(name, record, POSE_NAME_SIZE);
+  }
+
+  name[POSE_NAME_SIZE] = '\0';
+  return true;
+}
+
+/**
+ * Look a pose up by name
+ *
+ * @param name    Name, ends at a NUL or ','
+ * @returns int   Pose index, -1 if there is no pose with that name
+ */
+int poseFind(const char *name)
+{
+  int length = 0;
+  while (name[length] && name[length] != ',')
+    length++;
+  if (length == 0 || length > POSE_NAME_SIZE)
+    return -1;
+
+  char candidate[POSE_NAME_SIZE + 1];
+  for (int index = 0; index < POSE_COUNT; index++)
+  {
+    if (poseGetName(index, candidate) && !strncmp(candidate, name, length) && candidate[length] == '\0')
+      return index;
+  }
+  return -1;
+}
+
+/**
+ * Save SERVO_POSITION as a user pose. The EEPROM is written in the background by poseLibraryTick()
+ *
+ * @param slot    User slot
+ * @param name    Name, at most POSE_NAME_SIZE chars are kept. Ends at a NUL or ','
+ * @param length  Most chars of name to use
+ * @returns bool  False if slot is out of range or another capture is still being written
+ */
+bool poseCapture(uint8_t slot, const char *name, int length)
+{
+  if (slot >= POSE_USER_SLOTS || poseWriteIndex < POSE_RECORD_SIZE)
+    return false;
+
+  bool ended = false;
+  for (int i = 0; i < POSE_NAME_SIZE; i++)
+  {
+    ended = ended || i >= length || !name[i] || name[i] == ',';
+    poseRecord[i] = ended ? '\0' : name[i];
+  }
+  for (int i = 0; i < SERVO_COUNT; i++)
+    poseRecord[POSE_NAME_SIZE + i] = SERVO_POSITION[i];
+
+  uint8_t crc = 0xFF;
+  for (int i = 0; i < POSE_RECORD_SIZE - 1; i++)
+    crc = crc8Update(crc, poseRecord[i]);
+  poseRecord[POSE_RECORD_SIZE - 1] = crc;
+
+  poseWriteSlot = slot;
+  poseWriteIndex = 0;
+  return true;
+}
+
+/** Write a byte of a captured pose. Call often, never waits on the EEPROM */
+void poseLibraryTick()
+{
+  if (poseWriteIndex >= POSE_RECORD_SIZE || !eeprom_is_ready())
+    return;
+
+  eeprom_update_byte(poseSlotAddress(poseWriteSlot) + poseWriteIndex, poseRecord[poseWriteIndex]);
+  poseWriteIndex++;
+}
+
+/**
+ * Start moving every servo to a pose
+ *
+ * @param index     Pose index
+ * @param duration  Time the transition takes, ms
+ * @returns bool    False if there is no such pose
+ */
+bool poseTransition(int index, uint16_t duration)
+{
+  if (!poseGet(index, poseTo))
+    return false;
+
+  for (int i = 0; i < SERVO_COUNT; i++)
+    poseFrom[i] = SERVO_POSITION[i];
+  poseTransitionLastTick = controlMillis();
+  poseTransitionElapsed = 0;
+  poseTransitionDuration = duration;
+  poseTransitionActive = true;
+  return true;
+}
+
+/** Advance the transition in progress. Call every SERVO_FRAME_TIME */
+void poseTransitionTick()
+{
+  if (!poseTransitionActive)
+    return;
+
+  unsigned long now = controlMillis();
+  poseTransitionElapsed += (now - poseTransitionLastTick) * stabilityPace() / STABILITY_PACE_FULL;
+  poseTransitionLastTick = now;
+
+  unsigned long elapsed = poseTransitionElapsed;
+  int pose[SERVO_COUNT];
+
+  if (elapsed >= poseTransitionDuration)
+  {
+    poseTransitionActive = false;
+    servoSetFrame(poseTo, false);
+
+    // Let setTibias and setFemurs carry on from here
+    allTibiaLastPos = getServoPositionRelativeInitial(TIBIA_SERVOS[0]);
+    allFemureLastPos = getServoPositionRelativeInitial(FEMUR_SERVOS[0]);
+    return;
+  }
+
+  // Smoothstep easing, 0 to 1024: starts and stops gently instead of jerking the body
+  long t = elapsed * 1024 / poseTransitionDuration;
+  long blend = t * t / 1024 * (3 * 1024 - 2 * t) / 1024;
+
+  for (int i = 0; i < SERVO_COUNT; i++)
+    pose[i] = poseFrom[i] + (int)((poseTo[i] - poseFrom[i]) * blend / 1024);
+  servoSetFrame(pose, false);
+}
+
+#endif
@@ -0,0 +1,184 @@
+/**
+ * PoseStore.h
+ * Keeps the last commanded pose in EEPROM so a reset can start from where the legs are
+ *
+ * The pose saved is SERVO_OUTPUT, what the servos were last sent with the gait, body and
+ * manual layers mixed in, not the SERVO_POSITION base under them. The layers do not survive
+ * a reset, so on restore the whole pose becomes the base and the legs start where they are.
+ *
+ * Records are written round a ring of POSE_STORE_SLOTS slots to spread EEPROM wear.
+ * Each record holds a sequence number, one angle per servo and a CRC, so a record
+ * cut short by a reset is simply ignored. Saving writes one byte per poseStoreTick()
+ * and never waits on the EEPROM, so it does not hold up a move
+ */
+
+#ifndef POSE_STORE_H
+#define POSE_STORE_H
+
+#include <avr/eeprom.h>
+
+/** Record layout: sequence, one angle per servo, CRC */
+#define POSE_STORE_RECORD_SIZE (SERVO_COUNT + 2)
+
+/** Slot and sequence number of the next record */
+int poseStoreNextSlot = 0;
+uint8_t poseStoreSequence = 0;
+
+/** Record being written. Nothing is being written once poseStoreWriteIndex reaches POSE_STORE_RECORD_SIZE */
+uint8_t poseStoreRecord[POSE_STORE_RECORD_SIZE];
+int poseStoreWriteIndex = POSE_STORE_RECORD_SIZE;
+
+/** Pose held by the newest record */
+int poseStoreSaved[SERVO_COUNT];
+
+unsigned long poseStoreLastSave = 0;
+unsigned long poseStoreLastActivity = 0;
+unsigned long poseStoreSeenUpdates = 0;
+
+/** Number of records written since boot, reported through telemetry */
+unsigned long POSE_STORE_SAVES = 0;
+
+/**
+ * Get the EEPROM address of a slot
+ *
+ * @param slot  Slot index
+ */
+uint8_t *poseStoreSlotAddress(int slot)
+{
+  return (uint8_t *)(POSE_STORE_ADDRESS + slot * POSE_STORE_RECORD_SIZE);
+}
+
+/**
+ * Read a slot and check it holds a complete record
+ *
+ * @param slot    Slot index
+ * @param record  Filled with the record bytes
+ * @returns bool  True if the CRC and angles are valid
+ */
+bool poseStoreReadSlot(int slot, uint8_t record[])
+{
+  eeprom_read_block(record, poseStoreSlotAddress(slot), POSE_STORE_RECORD_SIZE);
+
+  uint8_t crc = 0xFF;
+  for (int i = 0; i < POSE_STORE_RECORD_SIZE - 1; i++)
+    crc = crc8Update(crc, record[i]);
+  if (crc != record[POSE_STORE_RECORD_SIZE - 1])
+    return false;
+
+  for (int i = 0; i < SERVO_COUNT; i++)
+  {
+    if (record[i + 1] > 180)
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Load the newest valid record. Call once at boot, before anything is saved
+ *
+ * @param pose    Filled with the stored pose if one is found
+ * @returns bool  True if a stored pose was found
+ */
+bool poseStoreRestore(int pose[])
+{
+  uint8_t record[POSE_STORE_RECORD_SIZE];
+  int newest = -1;
+  uint8_t newestSequence = 0;
+
+  for (int slot = 0; slot < POSE_STORE_SLOTS; slot++)
+  {
+    if (!poseStoreReadSlot(slot, record))
+      continue;
+
+    // Valid records are never more than POSE_STORE_SLOTS apart, so wrap-around compare is safe
+    if (newest < 0 || (int8_t)(record[0] - newestSequence) > 0)
+    {
+      newest = slot;
+      newestSequence = record[0];
+    }
+  }
+
+  if (newest < 0)
+  {
+    DEBUG_PRINT("No stored pose");
+    return false;
+  }
+
+  poseStoreReadSlot(newest, record);
+  for (int i = 0; i < SERVO_COUNT; i++)
+  {
+    pose[i] = record[i + 1];
+    poseStoreSaved[i] = pose[i];
+  }
+
+  poseStoreNextSlot = (newest + 1) % POSE_STORE_SLOTS;
+  poseStoreSequence = newestSequence + 1;
+
+  DEBUG_PRINT("Restored pose from slot " + (String)newest);
+  return true;
+}
+
+/** Start writing SERVO_OUTPUT to the next slot */
+void poseStoreSave()
+{
+  uint8_t crc = 0xFF;
+
+  poseStoreRecord[0] = poseStoreSequence++;
+  crc = crc8Update(crc, poseStoreRecord[0]);
+  for (int i = 0; i < SERVO_COUNT; i++)
+  {
+    poseStoreSaved[i] = SERVO_OUTPUT[i];
+    poseStoreRecord[i + 1] = SERVO_OUTPUT[i];
+    crc = crc8Update(crc, poseStoreRecord[i + 1]);
+  }
+  poseStoreRecord[POSE_STORE_RECORD_SIZE - 1] = crc;
+
+  poseStoreWriteIndex = 0;
+}
+
+/**
+ * Save the pose when it has changed and the servos have been idle for POSE_STORE_IDLE_TIME,
+ * or at most every POSE_STORE_INTERVAL while they keep moving. Call often
+ */
+void poseStoreTick()
+{
+  if (poseStoreWriteIndex < POSE_STORE_RECORD_SIZE)
+  {
+    if (!eeprom_is_ready())
+      return;
+
+    eeprom_update_byte(poseStoreSlotAddress(poseStoreNextSlot) + poseStoreWriteIndex, poseStoreRecord[poseStoreWriteIndex]);
+    if (++poseStoreWriteIndex == POSE_STORE_RECORD_SIZE)
+    {
+      poseStoreNextSlot = (poseStoreNextSlot + 1) % POSE_STORE_SLOTS;
+      POSE_STORE_SAVES++;
+    }
+    return;
+  }
+
+  // Any update that had something to send, even one the driver deferred, means the servos are moving
+  unsigned long now = millis();
+  unsigned long updates = SERVO_UPDATES_PERFORMED + SERVO_UPDATES_DEFERRED;
+  if (updates != poseStoreSeenUpdates)
+  {
+    poseStoreSeenUpdates = updates;
+    poseStoreLastActivity = now;
+  }
+
+  bool changed = false;
+  for (int i = 0; i < SERVO_COUNT; i++)
+  {
+    if (SERVO_OUTPUT[i] != poseStoreSaved[i])
+      changed = true;
+  }
+  if (!changed)
+    return;
+
+  if (now - poseStoreLastActivity >= POSE_STORE_IDLE_TIME || now - poseStoreLastSave >= POSE_STORE_INTERVAL)
+  {
+    poseStoreLastSave = now;
+    poseStoreSave();
+  }
+}
+
+#endif
@@ -0,0 +1,225 @@
+/**
+ * Preview.h
+ * Dry runs of a motion: how long it takes, where it ends and what it runs into, before the robot moves
+ *
+ * A preview starts a motion program, pose transition or the uploaded spline and runs the real
+ * controlTick() on it, a frame after the other without waiting, so the mixer, joint guard and
+ * stability pacing all act on it as they would for real. servoPreviewing keeps the frames away
+ * from the driver and controlMillis() on a virtual clock. Afterwards the servo state, source
+ * state and counters it touched are put back, so nothing shows it ran.
+ *
+ * Only the source being previewed runs, so a preview is refused while anything else is moving.
+ * It is asked for by OP_PREVIEW and run from loop(), never inside a blocking move. serialPoll()
+ * runs after every frame so received bytes are not lost, but only collects them: the first
+ * text line and the first packet to complete wait for the preview to finish, and whatever
+ * follows them waits in the UART buffer. The answer is OP_PREVIEW_RESULT:
+ *   uint8 PREVIEW_STATUS
+ *   uint16 duration     ms the motion takes
+ *   uint32 clipped      Joints that had to be clipped to 0 to 180, servo 0 in bit 0
+ *   uint32 guarded      Joints the joint guard clamped
+ *   int16 margin        Lowest stability margin on the way, mm
+ *   uint8 pose[SERVO_COUNT] Output at the end
+ */
+
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+typedef enum {
+  PREVIEW_PROGRAM = 0,  // uint8 slot
+  PREVIEW_POSE,         // uint8 pose index, uint16 duration (ms)
+  PREVIEW_SPLINE        // The uploaded path
+} PREVIEW_SOURCE;
+
+typedef enum {
+  PREVIEW_OK = 0,
+  PREVIEW_BUSY,         // Something is already moving
+  PREVIEW_INVALID,      // No such program slot or pose, or the path is incomplete
+  PREVIEW_FAULT,        // The program stopped on a bad instruction, slot or nesting
+  PREVIEW_TOO_LONG      // Still moving after PREVIEW_TIME_MAX
+} PREVIEW_STATUS;
+
+#define PREVIEW_RESULT_SIZE (13 + SERVO_COUNT)
+
+/** Preview asked for, run by previewPoll() */
+bool previewPending = false;
+uint8_t previewSource = 0;
+uint8_t previewIndex = 0;
+uint16_t previewDuration = 0;
+
+/** Counter reported through telemetry */
+unsigned long PREVIEWS_RUN = 0;
+
+/** Runs every SERVO_FRAME_TIME from loop(). Defined in AntdroidGenesis.ino */
+void controlTick();
+
+/** Takes received bytes off the UART. Defined in AntdroidGenesis.ino */
+void serialPoll();
+
+/**
+ * Take an OP_PREVIEW payload. The preview runs from the next previewPoll()
+ *
+ * @param payload uint8 PREVIEW_SOURCE followed by its arguments
+ * @param length  Payload length
+ * @returns bool  False if the payload is the wrong length for the source
+ */
+bool previewRequest(const uint8_t payload[], uint8_t length)
+{
+  if (length < 1)
+    return false;
+
+  switch (payload[0])
+  {
+  case PREVIEW_PROGRAM:
+    if (length != 2)
+      return false;
+    previewIndex = payload[1];
+    break;
+  case PREVIEW_POSE:
+    if (length != 4)
+      return false;
+    previewIndex = payload[1];
+    previewDuration = protocolRead16(payload + 2);
+    break;
+  case PREVIEW_SPLINE:
+    if (length != 1)
+      return false;
+    break;
+  default:
+    return false;
+  }
+
+  previewSource = payload[0];
+  previewPending = true;
+  return true;
+}
+
+/** True while any control tick source is moving the servos */
+bool previewSourcesBusy()
+{
+  return motionRunning || poseTransitionActive || splineRunning || streamActive || gaitState != GAIT_IDLE;
+}
+
+/**
+ * Start the source being previewed
+ *
+ * @returns bool  False if it would not start
+ */
+bool previewStart()
+{
+  switch (previewSource)
+  {
+  case PREVIEW_PROGRAM:
+    return previewIndex <= MOTION_PROGRAM_RAM_SLOT && motionProgramRun(previewIndex);
+  case PREVIEW_POSE:
+    return poseTransition(previewIndex, previewDuration);
+  case PREVIEW_SPLINE:
+    return splineRun();
+  }
+  return false;
+}
+
+/**
+ * Run a preview against a shadow copy of the servo state
+ *
+ * @param result  Filled with the OP_PREVIEW_RESULT payload
+ */
+void previewRun(uint8_t result[PREVIEW_RESULT_SIZE])
+{
+  memset(result, 0, PREVIEW_RESULT_SIZE);
+  if (previewSourcesBusy())
+  {
+    result[0] = PREVIEW_BUSY;
+    return;
+  }
+
+  // Everything the motion can change, to be put back afterwards
+  int position[SERVO_COUNT];
+  int output[SERVO_COUNT];
+  memcpy(position, SERVO_POSITION, sizeof(position));
+  memcpy(output, SERVO_OUTPUT, sizeof(output));
+  uint32_t dirty = SERVO_DIRTY;
+  uint32_t clipped = servoClipped;
+  int femurs = allFemureLastPos;
+  int tibias = allTibiaLastPos;
+  unsigned long counters[] = {GUARD_LIMIT_CLAMPS, GUARD_COXA_CLAMPS, GUARD_ENVELOPE_CLAMPS, STABILITY_LOW_TICKS,
+                              MOTION_PROGRAMS_RUN, MOTION_PROGRAM_ERRORS, SPLINES_RUN, SPLINE_ERRORS};
+  int worstMargin = STABILITY_WORST_MARGIN;
+
+  servoPreviewing = true;
+  servoPreviewClock = millis();
+  unsigned long start = servoPreviewClock;
+  servoClipped = 0;
+  guardClamped = 0;
+  uint32_t guarded = 0;
+  int margin = stabilityMargin;
+  PREVIEW_STATUS status = PREVIEW_OK;
+
+  if (!previewStart())
+    status = PREVIEW_INVALID;
+  while (status == PREVIEW_OK && previewSourcesBusy())
+  {
+    if (servoPreviewClock - start >= PREVIEW_TIME_MAX)
+    {
+      status = PREVIEW_TOO_LONG;
+      break;
+    }
+
+    servoPreviewClock += SERVO_FRAME_TIME;
+    controlTick();
+    guarded |= guardClamped;
+    if (stabilityMargin < margin)
+      margin = stabilityMargin;
+
+    // Frames run back to back, at 1Mbaud the UART buffer fills in under 3ms without this
+    serialPoll();
+  }
+  if (MOTION_PROGRAM_ERRORS != counters[5])
+    status = PREVIEW_FAULT;
+
+  result[0] = status;
+  protocolWrite16(result + 1, servoPreviewClock - start);
+  protocolWrite32(result + 3, servoClipped);
+  protocolWrite32(result + 7, guarded);
+  protocolWrite16(result + 11, margin);
+  for (int i = 0; i < SERVO_COUNT; i++)
+    result[13 + i] = SERVO_OUTPUT[i];
+
+  motionRunning = false;
+  poseTransitionActive = false;
+  splineRunning = false;
+  servoPreviewing = false;
+
+  memcpy(SERVO_POSITION, position, sizeof(position));
+  memcpy(SERVO_OUTPUT, output, sizeof(output));
+  SERVO_DIRTY = dirty;
+  servoClipped = clipped;
+  allFemureLastPos = femurs;
+  allTibiaLastPos = tibias;
+
+  // The feet and margin follow from SERVO_OUTPUT, work them out again before the counters go back
+  stabilityTick();
+  GUARD_LIMIT_CLAMPS = counters[0];
+  GUARD_COXA_CLAMPS = counters[1];
+  GUARD_ENVELOPE_CLAMPS = counters[2];
+  STABILITY_LOW_TICKS = counters[3];
+  MOTION_PROGRAMS_RUN = counters[4];
+  MOTION_PROGRAM_ERRORS = counters[5];
+  SPLINES_RUN = counters[6];
+  SPLINE_ERRORS = counters[7];
+  STABILITY_WORST_MARGIN = worstMargin;
+  PREVIEWS_RUN++;
+}
+
+/** Run a preview asked for by OP_PREVIEW and send the result. Call from loop() */
+void previewPoll()
+{
+  if (!previewPending)
+    return;
+  previewPending = false;
+
+  uint8_t result[PREVIEW_RESULT_SIZE];
+  previewRun(result);
+  protocolSend(OP_PREVIEW_RESULT, result, PREVIEW_RESULT_SIZE);
+}
+
+#endif
@@ -0,0 +1,178 @@
+/**
+ * Protocol.h
+ * Binary packets sent alongside the text commands
+ *
+ * Packet layout:
+ *   PROTOCOL_SYNC, length, opcode, payload[length], crc
+ * crc is crc8Update() over length, opcode and payload, starting from 0xFF.
+ * Multi-byte values are little endian.
+ *
+ * PROTOCOL_SYNC never appears in a text command, so a packet is recognised by its
+ * first byte whenever no text line is being received
+ */
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#define PROTOCOL_SYNC 0xA5
+#define PROTOCOL_MAX_PAYLOAD 64
+
+typedef enum {
+  OP_SETPOINT = 0x10,       // uint16 time (ms, host clock), uint8 position[SERVO_COUNT]
+  OP_SETPOINT_KEY = 0x11,   // Sequenced setpoint with every position, see DeltaCodec.h
+  OP_SETPOINT_DELTA = 0x12, // Sequenced setpoint with the changed positions, see DeltaCodec.h
+  OP_SETPOINT_ACK = 0x13,   // Sent back: uint8 sequence of an applied OP_SETPOINT_KEY or OP_SETPOINT_DELTA
+  OP_COMMAND = 0x20,        // uint8 sequence, text command as typed on the serial monitor
+  OP_COMMAND_ACK = 0x21,    // Sent back: uint8 sequence, uint8 COMMAND_STATUS, uint8 free queue slots,
+                            //   then int32 start error (us) when a timed command finishes
+  OP_COMMAND_AT = 0x22,     // uint8 sequence, uint32 start time (firmware micros()), text command
+  OP_PING = 0x30,           // uint32 host time
+  OP_PONG = 0x31,           // Sent back: uint32 host time from the ping, uint32 micros() when it arrived
+  OP_PROGRAM_WRITE = 0x40,  // uint8 offset, motion program bytes for the RAM slot
+  OP_PROGRAM_STORE = 0x41,  // uint8 slot: copy the RAM program into an EEPROM slot
+  OP_PROGRAM_RUN = 0x42,    // uint8 slot, MOTION_PROGRAM_RAM_SLOT for the RAM program
+  OP_PROGRAM_STOP = 0x43,
+  OP_POSE_CAPTURE = 0x50,   // uint8 user slot, name: save the current position as a user pose
+  OP_POSE_GOTO = 0x51,      // uint8 pose index, uint16 duration (ms): transition to a pose
+  OP_TWIST = 0x60,          // int16 forwards (mm/s), int16 left (mm/s), int16 turn (degrees/s anticlockwise),
+                            //   send again within GAIT_TWIST_TIMEOUT to keep walking
+  OP_SPLINE_WRITE = 0x70,   // uint8 offset, path bytes, see Spline.h. Offset 0 starts a new path
+  OP_SPLINE_RUN = 0x71,     // Run the uploaded path from where the joints are now
+  OP_SPLINE_STOP = 0x72,
+  OP_PREVIEW = 0x80,        // uint8 PREVIEW_SOURCE and its arguments: dry run a motion without moving, see Preview.h
+  OP_PREVIEW_RESULT = 0x81  // Sent back: duration, clipped and guarded joints, lowest margin and end pose
+} PROTOCOL_OPCODE;
+
+typedef enum {
+  PROTOCOL_WAIT_SYNC = 0,
+  PROTOCOL_WAIT_LENGTH,
+  PROTOCOL_WAIT_OPCODE,
+  PROTOCOL_WAIT_PAYLOAD,
+  PROTOCOL_WAIT_CRC
+} PROTOCOL_STATE;
+
+/** Packet being received, complete once protocolFeed returns true */
+uint8_t protocolOpcode;
+uint8_t protocolLength;
+uint8_t protocolPayload[PROTOCOL_MAX_PAYLOAD];
+
+PROTOCOL_STATE protocolState = PROTOCOL_WAIT_SYNC;
+uint8_t protocolReceived = 0;
+uint8_t protocolCrc = 0;
+
+/** Packets dropped for a bad CRC or length, reported through telemetry */
+unsigned long PROTOCOL_ERRORS = 0;
+
+/** True while part of a packet has been received */
+bool protocolBusy()
+{
+  return protocolState != PROTOCOL_WAIT_SYNC;
+}
+
+/** Drop a partly received packet, used when the rest of it never arrives */
+void protocolReset()
+{
+  if (protocolBusy())
+    PROTOCOL_ERRORS++;
+  protocolState = PROTOCOL_WAIT_SYNC;
+}
+
+/**
+ * Feed one received byte to the packet decoder
+ *
+ * @param data    Received byte
+ * @returns bool  True when a complete packet with a valid CRC has been received
+ */
+bool protocolFeed(uint8_t data)
+{
+  switch (protocolState)
+  {
+  case PROTOCOL_WAIT_SYNC:
+    if (data == PROTOCOL_SYNC)
+      protocolState = PROTOCOL_WAIT_LENGTH;
+    return false;
+  case PROTOCOL_WAIT_LENGTH:
+    if (data > PROTOCOL_MAX_PAYLOAD)
+    {
+      PROTOCOL_ERRORS++;
+      protocolState = PROTOCOL_WAIT_SYNC;
+      return false;
+    }
+    protocolLength = data;
+    protocolCrc = crc8Update(0xFF, data);
+    protocolState = PROTOCOL_WAIT_OPCODE;
+    return false;
+  case PROTOCOL_WAIT_OPCODE:
+    protocolOpcode = data;
+    protocolCrc = crc8Update(protocolCrc, data);
+    protocolReceived = 0;
+    protocolState = protocolLength ? PROTOCOL_WAIT_PAYLOAD : PROTOCOL_WAIT_CRC;
+    return false;
+  case PROTOCOL_WAIT_PAYLOAD:
+    protocolPayload[protocolReceived++] = data;
+    protocolCrc = crc8Update(protocolCrc, data);
+    if (protocolReceived == protocolLength)
+      protocolState = PROTOCOL_WAIT_CRC;
+    return false;
+  case PROTOCOL_WAIT_CRC:
+    protocolState = PROTOCOL_WAIT_SYNC;
+    if (data != protocolCrc)
+    {
+      PROTOCOL_ERRORS++;
+      return false;
+    }
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Send a packet
+ *
+ * @param opcode  Packet opcode
+ * @param payload Payload bytes
+ * @param length  Payload length, at most PROTOCOL_MAX_PAYLOAD
+ */
+void protocolSend(uint8_t opcode, const uint8_t payload[], uint8_t length)
+{
+  uint8_t crc = crc8Update(0xFF, length);
+  crc = crc8Update(crc, opcode);
+
+  Uart.write(PROTOCOL_SYNC);
+  Uart.write(length);
+  Uart.write(opcode);
+  for (int i = 0; i < length; i++)
+  {
+    Uart.write(payload[i]);
+    crc = crc8Update(crc, payload[i]);
+  }
+  Uart.write(crc);
+}
+
+/** Read a little endian uint16 from a payload */
+uint16_t protocolRead16(const uint8_t *p)
+{
+  return p[0] | ((uint16_t)p[1] << 8);
+}
+
+/** Write a little endian uint16 into a payload */
+void protocolWrite16(uint8_t *p, uint16_t value)
+{
+  p[0] = value;
+  p[1] = value >> 8;
+}
+
+/** Read a little endian uint32 from a payload */
+uint32_t protocolRead32(const uint8_t *p)
+{
+  return protocolRead16(p) | ((uint32_t)protocolRead16(p + 2) << 16);
+}
+
+/** Write a little endian uint32 into a payload */
+void protocolWrite32(uint8_t *p, uint32_t value)
+{
+  protocolWrite16(p, value);
+  protocolWrite16(p + 2, value >> 16);
+}
+
+#endif
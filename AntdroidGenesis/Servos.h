@@ -14,22 +14,106 @@
 #include "Configuration.h"
 #endif
 
-/** Store servo positions in memory */
+/** Store servo positions in memory. These are the commanded positions, before the mixer layers */
 int SERVO_POSITION[18];
 
+/** Positions last sent to the driver, SERVO_POSITION with the mixer layers applied. See Mixer.h */
+int SERVO_OUTPUT[18];
+
 /** Default wait time inbetween servo updates */
 int SERVO_WAIT_TIME = SERVO_WAIT_TIME_DEFAULT;
 
+/** One bit per servo, set when its position or a mixer layer on it changed since the last servoUpdate() */
+uint32_t SERVO_DIRTY = 0;
+
+/** servoUpdate() counters, reported through telemetry */
+unsigned long SERVO_UPDATES_PERFORMED = 0; // Data was pushed to the driver
+unsigned long SERVO_UPDATES_SKIPPED = 0;   // Nothing changed, update was a no-op
+unsigned long SERVO_UPDATES_DEFERRED = 0;  // Driver busy, changes kept for the next update
+
+/** One bit per servo, set when a position had to be clipped to 0 to 180. Cleared by whoever reads it, see Preview.h */
+uint32_t servoClipped = 0;
+
+/** Set while a preview runs: frames are composed as usual but never sent, and control time is virtual. See Preview.h */
+bool servoPreviewing = false;
+unsigned long servoPreviewClock = 0;
+
+/**
+ * Get the time for the control tick sources. Use it instead of millis() in anything
+ * controlTick() runs, so a preview can run them far faster than real time
+ *
+ * @returns unsigned long ms, millis() unless a preview is running
+ */
+unsigned long controlMillis()
+{
+    return servoPreviewing ? servoPreviewClock : millis();
+}
+
+/**
+ * Record a new servo position and flag the servo as dirty
+ * 
+ * @param servoId Index of servo
+ * @param pos     Clamped absolute position
+ * @returns       True if the position changed
+ */
+bool servoMarkPosition(int servoId, int pos)
+{
+    if (SERVO_POSITION[servoId] == pos)
+        return false;
+
+    SERVO_POSITION[servoId] = pos;
+    SERVO_DIRTY |= (uint32_t)1 << servoId;
+    return true;
+}
+
+/** Combine positions and mixer layers and write the changed outputs. Defined in Mixer.h */
+uint32_t mixerCompose();
+
 /**********************************
  * Servo functions for onboard pwm drivers 
  **********************************/
 #ifdef SERVO_DRIVER_ONBOARD
+// Host builds bring their own Servo, see tools/MotionSimulator.cpp
+#ifdef ARDUINO
 #include <Servo.h>
+#endif
 
 Servo SERVO[18];
 
-/** Push positions to driver. Not used for SERVO_DRIVER_ONBOARD */
-void servoUpdate() {}
+/**
+ * Write an output position to a servo. Called by mixerCompose()
+ * 
+ * @param servoId Index of servo in SERVO[]
+ * @param pos     Absolute position, already clamped
+ */
+void servoWriteOutput(int servoId, int pos)
+{
+    SERVO[servoId].write(pos);
+}
+
+/** Compose and push positions to driver. Servo library writes immediately, so nothing is ever deferred */
+void servoUpdate()
+{
+    // A preview only needs the composed frame in SERVO_OUTPUT
+    if (servoPreviewing)
+    {
+        if (SERVO_DIRTY)
+            mixerCompose();
+        SERVO_DIRTY = 0;
+        return;
+    }
+
+    uint32_t dirty = SERVO_DIRTY;
+    SERVO_DIRTY = 0;
+
+    if (!dirty || !mixerCompose())
+    {
+        SERVO_UPDATES_SKIPPED++;
+        return;
+    }
+
+    SERVO_UPDATES_PERFORMED++;
+}
 
 /** 
  * Set servo to specified position 
@@ -37,7 +121,7 @@ void servoUpdate() {}
  * 
  * @param servoId Index of servo in SERVO[]
  * @param pos     Absolute position to set servo
- * @param update  Push update driver. Not used in SERVO_DRIVER_ONBOARD
+ * @param update  Push update driver. If not called, it will need to be manually called
  */
 void servoSet(int servoId, int pos, bool update)
 {
@@ -45,13 +129,16 @@ void servoSet(int servoId, int pos, bool update)
 
     if (SERVO_ENABLED[servoId])
     {
+        if (pos < 0 || pos > 180)
+            servoClipped |= (uint32_t)1 << servoId;
         if (pos < 0)
             pos = 0;
         if (pos > 180)
             pos = 180;
 
-        SERVO[servoId].write(pos);
-        SERVO_POSITION[servoId] = pos;
+        servoMarkPosition(servoId, pos);
+        if (update)
+            servoUpdate();
     }
 }
 
@@ -60,17 +147,25 @@ void servoSet(int servoId, int pos, bool update)
  * Attach servo to pin if no already attached and set send to initial position
  *
  * @param  index   Index of the servo in the SERVO array
+ * @param  pos     Position to start the servo at
 */
-void initializeServo(int index)
+void initializeServo(int index, int pos)
 {
+  // Write before attaching so the first pulse is already at the initial position
+  SERVO[index].write(pos);
+  SERVO_POSITION[index] = pos;
+  SERVO_OUTPUT[index] = pos;
+
   if (!SERVO[index].attached())
     SERVO[index].attach(SERVO_PIN_MAP[index]);
-
-  SERVO[index].write(SERVO_INITPOS_OFFSET[index]);
 }
 
-/** Build the servo array and initialize the servos */
-void initializeServos()
+/** 
+ * Build the servo array and initialize the servos
+ * 
+ * @param startPose Absolute position to start each servo at
+ */
+void initializeServos(const int startPose[])
 {
   DEBUG_PRINT("initalizeServos()");
 
@@ -81,7 +176,7 @@ void initializeServos()
       DEBUG_PRINT("Configuring servo " + (String)i + " on pin " + (String)SERVO_PIN_MAP[i]);
 
       SERVO[i] = Servo(); // Add the servo
-      initializeServo(i); // Initialize the servo
+      initializeServo(i, startPose[i]); // Initialize the servo
     }
     else
     {
@@ -98,13 +193,63 @@ void initializeServos()
 #include "Tlc5940.h"
 #include "tlc_servos.h"
 
-/** Push positions to TLC5940 driver */
+/** Output changes written to the TLC buffer but not shifted out yet */
+bool servoOutputPending = false;
+
+/**
+ * Write an output position into the TLC buffer. Called by mixerCompose()
+ * 
+ * @param servoId Index of servo
+ * @param pos     Absolute position, already clamped
+ */
+void servoWriteOutput(int servoId, int pos)
+{
+    // Servos past the last TLC channel have no output, setting them would write past the end of tlc_GSData
+    if (servoId < NUM_TLCS * 16)
+        tlc_setServo(servoId, pos);
+}
+
+/** 
+ * Compose and push positions to TLC5940 driver
+ * Skips the shift entirely when no output changed since the last update.
+ * If the previous data has not been latched yet the changes are kept pending,
+ * so they go out on the next call instead of being lost
+ */
 void servoUpdate()
 {
 #ifdef DEBUG_SERVO_SIGNAL
     DEBUG_PRINT("servoUpdate()");
 #endif
-    Tlc.update();
+    // A preview only needs the composed frame in SERVO_OUTPUT, the TLC is left alone
+    if (servoPreviewing)
+    {
+        if (SERVO_DIRTY)
+            mixerCompose();
+        SERVO_DIRTY = 0;
+        return;
+    }
+
+    if (SERVO_DIRTY)
+    {
+        SERVO_DIRTY = 0;
+        if (mixerCompose())
+            servoOutputPending = true;
+    }
+
+    if (!servoOutputPending)
+    {
+        SERVO_UPDATES_SKIPPED++;
+        return;
+    }
+
+    if (Tlc.update())
+    {
+        SERVO_UPDATES_DEFERRED++;
+        return;
+    }
+
+    servoOutputPending = false;
+    SERVO_UPDATES_PERFORMED++;
 }
 
 /** 
@@ -121,40 +266,50 @@ void servoSet(int servoId, int pos, bool update)
 
     if (SERVO_ENABLED[servoId])
     {
+        if (pos < 0 || pos > 180)
+            servoClipped |= (uint32_t)1 << servoId;
         if (pos < 0)
             pos = 0;
         if (pos > 180)
             pos = 180;
 
-        tlc_setServo(servoId, pos);
-        SERVO_POSITION[servoId] = pos;
+        servoMarkPosition(servoId, pos);
         if (update)
             servoUpdate();
     }
 }
 
-/** Build the servo array and initialize the servos */
-void initializeServos()
+/** 
+ * Initialize the TLC straight into the starting frame
+ * Outputs stay blanked until that frame is latched, so no servo is ever driven to 0 first.
+ * Disabled servos are left at 0
+ * 
+ * @param startPose Absolute position to start each servo at
+ */
+void initializeServos(const int startPose[])
 {
   DEBUG_PRINT("initalizeServos() with driver TLC_5940");
 
-  tlc_initServos();
-
-  for (int i = 0; i < 18; i++)
+  uint8_t initAngles[SERVO_COUNT];
+  for (int i = 0; i < SERVO_COUNT; i++)
   {
     if (SERVO_ENABLED[i])
     {
       DEBUG_PRINT("Configuring servo " + (String)i + " on pin " + (String)SERVO_PIN_MAP[i]);
-      
-      servoSet(i, SERVO_INITPOS_OFFSET[i], true);
+
+      initAngles[i] = constrain(startPose[i], 0, 180);
     }
     else
     {
       DEBUG_PRINT("Skipping servo " + (String)i + " configuration for pin " + (String)SERVO_PIN_MAP[i]);
-    }
 
-    delay(SERVO_SETUP_DELAY);
+      initAngles[i] = 0;
+    }
+    SERVO_POSITION[i] = initAngles[i];
+    SERVO_OUTPUT[i] = initAngles[i];
   }
+
+  tlc_initServos(initAngles, SERVO_COUNT < NUM_TLCS * 16 ? SERVO_COUNT : NUM_TLCS * 16);
 }
 
 #endif
@@ -163,6 +318,29 @@ void initializeServos()
  *    Common servo functions      *
  **********************************/
 
+/** Start the servos at their calibrated initial positions */
+void initializeServos()
+{
+    initializeServos(SERVO_INITPOS_OFFSET);
+}
+
+/** Background work that has to keep running while a blocking move waits. Defined in AntdroidGenesis.ino */
+void servoIdle();
+
+/**
+ * Wait between steps of a blocking move, running servoIdle() meanwhile
+ * 
+ * @param ms  Time to wait
+ */
+void servoDelay(unsigned long ms)
+{
+    unsigned long start = millis();
+    do
+    {
+        servoIdle();
+    } while (millis() - start < ms);
+}
+
 /**
  * Get absolute position of servo
  * 
@@ -196,7 +374,7 @@ int getServoPositionRelativeInitial(int servoId)
    @param servoWaitTime Delay between each position iteration
    @param servoInvertedState  Array of servo inverted states
 */
-void servoSetRelativeToInital(int _servos[], int servoCount, int startingPos, int targetPos, int servoWaitTime, int servoInvertedState[])
+void servoSetRelativeToInital(const int _servos[], int servoCount, int startingPos, int targetPos, int servoWaitTime, const int servoInvertedState[])
 {
     DEBUG_PRINT("servoSetRelativeToInital()");
 
@@ -213,7 +391,7 @@ void servoSetRelativeToInital(int _servos[], int servoCount, int startingPos, in
             }
             servoUpdate();
 
-            delay(servoWaitTime);
+            servoDelay(servoWaitTime);
         }
     }
     else
@@ -227,7 +405,7 @@ void servoSetRelativeToInital(int _servos[], int servoCount, int startingPos, in
             }
             servoUpdate();
 
-            delay(servoWaitTime);
+            servoDelay(servoWaitTime);
         }
     }
 }
@@ -242,7 +420,7 @@ void servoSetRelativeToInital(int _servos[], int servoCount, int startingPos, in
    @param targetPos     The target servo position
    @param servoWaitTime Delay between each position iteration
 */
-void servoSetRelativeToInital(int _servos[], int servoCount, int startingPos, int targetPos, int servoWaitTime)
+void servoSetRelativeToInital(const int _servos[], int servoCount, int startingPos, int targetPos, int servoWaitTime)
 {
     servoSetRelativeToInital(_servos, servoCount, startingPos, targetPos, servoWaitTime, SERVO_INVERTED_STATE);
 }
@@ -251,7 +429,7 @@ void servoSetRelativeToInital(int _servos[], int servoCount, int startingPos, in
    Overload for bulkSetRelativeToInital with SERVO_WAIT_TIME for
     servoWaitTime param
 */
-void servoSetRelativeToInital(int _servos[], int servoCount, int startingPos, int targetPos)
+void servoSetRelativeToInital(const int _servos[], int servoCount, int startingPos, int targetPos)
 {
     servoSetRelativeToInital(_servos, servoCount, startingPos, targetPos, SERVO_WAIT_TIME);
 }
@@ -267,7 +445,8 @@ void setSingleServoRelativeToInitial(int servoId, int targetPos, int servoWaitTi
 {
     DEBUG_PRINT("setSingleServoRelativeToInitial(" + (String)servoId + ", " + (String)targetPos + ", " + (String)servoWaitTime);
 
-    servoSetRelativeToInital(new int[1]{servoId}, 1, getServoPositionRelativeInitial(servoId), targetPos, servoWaitTime);
+    int servos[1] = {servoId};
+    servoSetRelativeToInital(servos, 1, getServoPositionRelativeInitial(servoId), targetPos, servoWaitTime);
 }
 
 /**
@@ -282,7 +461,8 @@ void setSingleServoRelativeToSelf(int servoId, int targetPos, int servoWaitTime)
     int currentServoPos = getServoPositionRelativeInitial(servoId);
     targetPos += currentServoPos;
 
-    servoSetRelativeToInital(new int[1]{servoId}, 1, currentServoPos, targetPos, servoWaitTime);
+    int servos[1] = {servoId};
+    servoSetRelativeToInital(servos, 1, currentServoPos, targetPos, servoWaitTime);
 }
 
 /**
@@ -318,7 +498,7 @@ void servoSmoothSet(int servoId, int pos, int servoWaitTime)
             for (int i = current; i <= pos; i++)
             {
                 servoSet(servoId, i, true);
-                delay(servoWaitTime);
+                servoDelay(servoWaitTime);
             }
         }
         else
@@ -326,7 +506,7 @@ void servoSmoothSet(int servoId, int pos, int servoWaitTime)
             for (int i = current; i >= pos; i--)
             {
                 servoSet(servoId, i, true);
-                delay(servoWaitTime);
+                servoDelay(servoWaitTime);
             }
         }
     }
@@ -340,4 +520,108 @@ void servoSmoothSet(int servoId, int pos)
     servoSmoothSet(servoId, pos, SERVO_WAIT_TIME);
 }
 
+/**
+ * Set every servo to a new position and push them to the driver as one frame
+ * 
+ * @param pose    Absolute position for each servo
+ * @param update  Push the frame now. Control tick sources leave it to the single update at the end of the tick
+ */
+void servoSetFrame(const int pose[], bool update = true)
+{
+    for (int i = 0; i < SERVO_COUNT; i++)
+        servoSet(i, pose[i], false);
+
+    if (update)
+        servoUpdate();
+}
+
+/**
+ * Move every servo a degree at a time towards a pose, all of them stepping in the same frame.
+ * The per servo speed of servoSmoothSet(), but for several servos at once
+ * 
+ * @param pose          Absolute target position for each servo
+ * @param servoWaitTime Delay between each step
+ */
+void servoSmoothSetFrame(const int pose[], int servoWaitTime)
+{
+    for (;;)
+    {
+        bool reached = true;
+
+        for (int i = 0; i < SERVO_COUNT; i++)
+        {
+            int target = constrain(pose[i], 0, 180);
+            if (!SERVO_ENABLED[i] || SERVO_POSITION[i] == target)
+                continue;
+
+            servoSet(i, SERVO_POSITION[i] + (target > SERVO_POSITION[i] ? 1 : -1), false);
+            reached = false;
+        }
+        if (reached)
+            break;
+
+        servoUpdate();
+        servoDelay(servoWaitTime);
+    }
+}
+
+/**
+ * Move all servos together from their current positions to a pose
+ * Every servo follows a straight line so all of them arrive at the same time.
+ * The total movement in a frame is capped at SERVO_RAMP_MAX_STEP degrees to limit
+ * current draw, which can stretch the ramp past duration. When it caps, every
+ * servo's step is scaled down by the same factor, so they still move in proportion
+ * 
+ * @param pose      Absolute target position for each servo
+ * @param duration  Time the ramp should take, in ms
+ */
+void servoRampToPose(const int pose[], int duration)
+{
+    DEBUG_PRINT("servoRampToPose(" + (String)duration + ")");
+
+    int start[SERVO_COUNT];
+    for (int i = 0; i < SERVO_COUNT; i++)
+        start[i] = SERVO_POSITION[i];
+
+    int frames = duration / SERVO_FRAME_TIME;
+    if (frames < 1)
+        frames = 1;
+
+    for (int frame = 1;; frame++)
+    {
+        int planned = frame < frames ? frame : frames;
+        int steps[SERVO_COUNT];
+        int total = 0;
+
+        for (int i = 0; i < SERVO_COUNT; i++)
+        {
+            int target = constrain(pose[i], 0, 180);
+            int want = start[i] + (int)((long)(target - start[i]) * planned / frames);
+            steps[i] = SERVO_ENABLED[i] ? want - SERVO_POSITION[i] : 0;
+            total += abs(steps[i]);
+        }
+
+        bool reached = true;
+        for (int i = 0; i < SERVO_COUNT; i++)
+        {
+            if (!SERVO_ENABLED[i])
+                continue;
+
+            int step = steps[i];
+            if (total > SERVO_RAMP_MAX_STEP)
+                step = (int)((long)step * SERVO_RAMP_MAX_STEP / total);
+
+            servoSet(i, SERVO_POSITION[i] + step, false);
+            if (SERVO_POSITION[i] != constrain(pose[i], 0, 180))
+                reached = false;
+        }
+        servoUpdate();
+
+        if (frame >= frames && reached)
+            break;
+
+        servoDelay(SERVO_FRAME_TIME);
+    }
+}
+
 #endif
\ No newline at end of file
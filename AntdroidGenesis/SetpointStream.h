@@ -0,0 +1,294 @@
+/**
+ * SetpointStream.h
+ * Streaming mode: the host sends timestamped full poses (OP_SETPOINT) at 50-100Hz and
+ * the firmware plays them back on its own control clock
+ *
+ * Setpoints wait in a small jitter buffer and are played STREAM_DELAY ms behind the host
+ * clock, interpolating between the two setpoints either side of the playback time. So a
+ * late packet costs nothing as long as it arrives within STREAM_DELAY. If the buffer runs
+ * dry the pose is extrapolated from the last two setpoints for up to STREAM_EXTRAPOLATE_TIME,
+ * then held
+ *
+ * OP_SETPOINT_KEY and OP_SETPOINT_DELTA carry the same setpoints with a sequence number,
+ * the delta form only sending the joints that changed. Each one applied is acknowledged
+ * so the host knows which poses it can encode against
+ */
+
+#ifndef SETPOINT_STREAM_H
+#define SETPOINT_STREAM_H
+
+#define STREAM_BUFFER_SIZE 8            // Setpoints held in the jitter buffer
+#define STREAM_DELAY 60                 // Playback runs this many ms behind the host timestamps
+#define STREAM_EXTRAPOLATE_TIME 60      // Longest time to extrapolate past the newest setpoint
+#define STREAM_TIMEOUT 1000             // Streaming mode ends after this long without a setpoint
+
+typedef struct {
+  uint16_t time;                  // Host clock, ms
+  uint8_t position[SERVO_COUNT];  // Absolute servo positions
+} STREAM_SETPOINT;
+
+/** Jitter buffer, oldest setpoint at streamHead */
+STREAM_SETPOINT streamBuffer[STREAM_BUFFER_SIZE];
+uint8_t streamHead = 0;
+uint8_t streamCount = 0;
+
+/** True while setpoints are being played back */
+bool streamActive = false;
+bool streamUnderrun = false;
+
+/** True once the slot before streamHead holds the setpoint played before the oldest one */
+bool streamHasPrevious = false;
+
+/** millis() minus host time, fixed when streaming starts */
+uint16_t streamClockOffset = 0;
+unsigned long streamLastReceived = 0;
+
+/** Last DELTA_HISTORY sequenced setpoints, which delta frames are decoded against */
+uint8_t streamReference[DELTA_HISTORY][SERVO_COUNT];
+uint8_t streamReferenceSequence[DELTA_HISTORY];
+uint8_t streamReferenceCount = 0;
+uint8_t streamReferenceNext = 0;
+
+/** Counters reported through telemetry */
+unsigned long STREAM_SETPOINTS = 0;      // Setpoints received
+unsigned long STREAM_KEYFRAMES = 0;      // Of which keyframes
+unsigned long STREAM_DELTAS = 0;         // Of which delta frames
+unsigned long STREAM_UNKNOWN_BASE = 0;   // Delta frame against a setpoint no longer held, dropped
+unsigned long STREAM_UNDERRUNS = 0;      // Buffer ran dry and playback had to extrapolate
+unsigned long STREAM_OVERRUNS = 0;       // Buffer was full, oldest setpoint dropped
+unsigned long STREAM_LATE = 0;           // Setpoint arrived after its playback time, dropped
+
+/**
+ * Get a buffered setpoint
+ *
+ * @param index Position in the buffer, 0 is the oldest
+ */
+STREAM_SETPOINT *streamAt(uint8_t index)
+{
+  return &streamBuffer[(streamHead + index) % STREAM_BUFFER_SIZE];
+}
+
+/** Current playback time on the host clock */
+uint16_t streamPlaybackTime()
+{
+  return (uint16_t)millis() - streamClockOffset - STREAM_DELAY;
+}
+
+/**
+ * Add a setpoint to the jitter buffer
+ *
+ * @param time      Host time, ms
+ * @param position  One position per servo
+ */
+void streamReceive(uint16_t time, const uint8_t position[])
+{
+  STREAM_SETPOINTS++;
+  streamLastReceived = millis();
+
+  if (!streamActive)
+  {
+    // Start of a stream, anchor the host clock so this setpoint plays STREAM_DELAY from now
+    streamActive = true;
+    streamUnderrun = false;
+    streamHasPrevious = false;
+    streamCount = 0;
+    streamClockOffset = (uint16_t)millis() - time;
+  }
+
+  // Timestamps have to keep increasing, and a setpoint already behind playback is useless
+  if (streamCount > 0 && (int16_t)(time - streamAt(streamCount - 1)->time) <= 0)
+  {
+    STREAM_LATE++;
+    return;
+  }
+  int16_t lead = time - streamPlaybackTime();
+  if (lead < 0)
+  {
+    STREAM_LATE++;
+    if (!streamUnderrun)
+      return;
+
+    // Playback has run dry and fallen behind the host, so anchor the clock again
+    streamClockOffset = (uint16_t)millis() - time;
+    lead = STREAM_DELAY;
+  }
+
+  // Follow drift between the host clock and millis() a millisecond at a time
+  if (lead > STREAM_DELAY + STREAM_DELAY / 2)
+    streamClockOffset--;
+  else if (lead < STREAM_DELAY / 2)
+    streamClockOffset++;
+
+  if (streamCount == STREAM_BUFFER_SIZE)
+  {
+    STREAM_OVERRUNS++;
+    streamHead = (streamHead + 1) % STREAM_BUFFER_SIZE;
+    streamCount--;
+    streamHasPrevious = true;
+  }
+
+  STREAM_SETPOINT *setpoint = streamAt(streamCount++);
+  setpoint->time = time;
+  for (int i = 0; i < SERVO_COUNT; i++)
+    setpoint->position[i] = position[i];
+}
+
+/**
+ * Remember a sequenced setpoint, acknowledge it and add it to the jitter buffer
+ *
+ * @param sequence  Setpoint sequence number
+ * @param time      Host time, ms
+ * @param position  One position per servo
+ */
+void streamApplySequenced(uint8_t sequence, uint16_t time, const uint8_t position[])
+{
+  uint8_t *reference = streamReference[streamReferenceNext];
+  for (int i = 0; i < SERVO_COUNT; i++)
+    reference[i] = position[i];
+  streamReferenceSequence[streamReferenceNext] = sequence;
+  streamReferenceNext = (streamReferenceNext + 1) % DELTA_HISTORY;
+  if (streamReferenceCount < DELTA_HISTORY)
+    streamReferenceCount++;
+
+  protocolSend(OP_SETPOINT_ACK, &sequence, 1);
+  streamReceive(time, position);
+}
+
+/**
+ * Add a setpoint from an OP_SETPOINT_KEY payload. Earlier sequenced setpoints are kept,
+ * the host goes on encoding against them until the keyframe's acknowledgement reaches it
+ *
+ * @param payload Payload
+ * @param length  Payload length
+ */
+void streamReceiveKey(const uint8_t payload[], uint8_t length)
+{
+  if (length != 3 + SERVO_COUNT)
+  {
+    PROTOCOL_ERRORS++;
+    return;
+  }
+
+  STREAM_KEYFRAMES++;
+  streamApplySequenced(payload[0], protocolRead16(payload + 1), payload + 3);
+}
+
+/**
+ * Add a setpoint from an OP_SETPOINT_DELTA payload
+ *
+ * @param payload Payload
+ * @param length  Payload length
+ */
+void streamReceiveDelta(const uint8_t payload[], uint8_t length)
+{
+  if (length < 4)
+  {
+    PROTOCOL_ERRORS++;
+    return;
+  }
+
+  // Find the setpoint it was encoded against, newest first
+  uint8_t *base = 0;
+  for (int i = 1; i <= streamReferenceCount && !base; i++)
+  {
+    uint8_t slot = (streamReferenceNext + DELTA_HISTORY - i) % DELTA_HISTORY;
+    if (streamReferenceSequence[slot] == payload[1])
+      base = streamReference[slot];
+  }
+  if (!base)
+  {
+    // The host recovers with a keyframe once this goes unacknowledged
+    STREAM_UNKNOWN_BASE++;
+    return;
+  }
+
+  uint8_t position[SERVO_COUNT];
+  if (deltaDecode(base, payload + 4, length - 4, SERVO_COUNT, position) != length - 4)
+  {
+    PROTOCOL_ERRORS++;
+    return;
+  }
+
+  STREAM_DELTAS++;
+  streamApplySequenced(payload[0], protocolRead16(payload + 2), position);
+}
+
+/**
+ * Position of a servo at a time between or after two setpoints
+ *
+ * @param a       Earlier setpoint
+ * @param b       Later setpoint
+ * @param servoId Servo
+ * @param time    Host time, may be after b
+ */
+int streamInterpolate(STREAM_SETPOINT *a, STREAM_SETPOINT *b, int servoId, uint16_t time)
+{
+  long span = (uint16_t)(b->time - a->time);
+  long elapsed = (uint16_t)(time - a->time);
+  int from = a->position[servoId];
+  int to = b->position[servoId];
+
+  return from + (int)((to - from) * elapsed / span);
+}
+
+/** Play the stream for one control tick. Call every SERVO_FRAME_TIME */
+void streamTick()
+{
+  if (!streamActive)
+    return;
+
+  if (millis() - streamLastReceived > STREAM_TIMEOUT)
+  {
+    DEBUG_PRINT("Setpoint stream timed out");
+    streamActive = false;
+
+    // The host's encoder starts again with a keyframe, nothing it sent before can be a base
+    streamReferenceCount = 0;
+    return;
+  }
+
+  uint16_t now = streamPlaybackTime();
+
+  // Nothing to play until the first setpoint is due
+  if (streamCount == 0 || (int16_t)(now - streamAt(0)->time) < 0)
+    return;
+
+  // Drop setpoints playback has moved past, keeping the one just before now
+  while (streamCount > 1 && (int16_t)(now - streamAt(1)->time) >= 0)
+  {
+    streamHead = (streamHead + 1) % STREAM_BUFFER_SIZE;
+    streamCount--;
+    streamHasPrevious = true;
+  }
+
+  int pose[SERVO_COUNT];
+  if (streamCount > 1)
+  {
+    streamUnderrun = false;
+    for (int i = 0; i < SERVO_COUNT; i++)
+      pose[i] = streamInterpolate(streamAt(0), streamAt(1), i, now);
+  }
+  else
+  {
+    // Ran dry. Keep the previous setpoint so the last segment can be extrapolated
+    if (!streamUnderrun)
+    {
+      streamUnderrun = true;
+      STREAM_UNDERRUNS++;
+    }
+
+    STREAM_SETPOINT *last = streamAt(0);
+    STREAM_SETPOINT *previous = &streamBuffer[(streamHead + STREAM_BUFFER_SIZE - 1) % STREAM_BUFFER_SIZE];
+    uint16_t past = now - last->time;
+    if (past > STREAM_EXTRAPOLATE_TIME)
+      past = STREAM_EXTRAPOLATE_TIME;
+
+    bool canExtrapolate = streamHasPrevious && (uint16_t)(last->time - previous->time) <= 4 * STREAM_DELAY;
+    for (int i = 0; i < SERVO_COUNT; i++)
+      pose[i] = canExtrapolate ? streamInterpolate(previous, last, i, last->time + past) : last->position[i];
+  }
+
+  servoSetFrame(pose, false);
+}
+
+#endif
@@ -0,0 +1,243 @@
+/**
+ * Spline.h
+ * Smooth paths through uploaded waypoints for a group of joints, run without blocking
+ *
+ * A path is uploaded into splineBuffer with OP_SPLINE_WRITE and started with OP_SPLINE_RUN.
+ * Record layout:
+ *   uint8 mask[3]     Joints the path moves, servo 0 in bit 0 of the first byte
+ *   uint8 count       Number of knots
+ *   count knots of:
+ *     uint16 time     ms from the knot before, the first knot from where the joints were
+ *     int8 position   Relative to initial, like MP_SET, one per joint in the mask in servo order
+ *
+ * The joints go through every knot on a cubic Hermite curve with Catmull-Rom tangents, which
+ * allow for knots that are unevenly spaced in time. They set off from and come to rest at the
+ * ends. Each segment is turned into a polynomial in fixed point when it starts, so a tick only
+ * costs a few multiplies per joint. It slows down while the stability margin is low
+ */
+
+#ifndef SPLINE_H
+#define SPLINE_H
+
+#define SPLINE_BUFFER_SIZE 255
+#define SPLINE_HEADER_SIZE 4
+#define SPLINE_POSITION_SHIFT 6   // Positions are worked in 1/64 degree
+#define SPLINE_TIME_SHIFT 10      // Time through a segment, 0 to 1 << SPLINE_TIME_SHIFT
+
+/** Path uploaded with OP_SPLINE_WRITE, and how much of it has been written */
+uint8_t splineBuffer[SPLINE_BUFFER_SIZE];
+uint8_t splineLength = 0;
+
+/** Path being run */
+bool splineRunning = false;
+uint32_t splineMask = 0;
+uint8_t splineCount = 0;
+uint8_t splineStride = 0;             // Bytes per knot
+int splineStart[SERVO_COUNT];         // Where the joints were, the knot before the first
+int splineSegment = -1;               // Knot the joints are heading for
+unsigned long splineSegmentStart = 0; // ms into the path the segment started
+unsigned long splineLastTick = 0;
+unsigned long splineElapsed = 0;      // ms of the path done, runs slow while stabilityPace() is low
+
+/** Segment polynomial for each joint, 1/64 degree: ((a * s + b) * s + c) * s + d */
+long splineCoefficients[SERVO_COUNT][4];
+
+/** Counters reported through telemetry */
+unsigned long SPLINES_RUN = 0;
+unsigned long SPLINE_ERRORS = 0;    // Paths rejected when run
+
+/**
+ * Get the time of a knot
+ *
+ * @param knot    Knot, below splineCount
+ * @returns long  ms from the knot before
+ */
+long splineKnotTime(int knot)
+{
+  const uint8_t *record = splineBuffer + SPLINE_HEADER_SIZE + knot * splineStride;
+  return record[0] | ((unsigned int)record[1] << 8);
+}
+
+/**
+ * Get the position of a joint at a knot
+ *
+ * @param knot    Knot, -1 for where the joint started. Past the last knot gives the last
+ * @param servoId Joint in splineMask
+ * @param index   Place of the joint in splineMask
+ * @returns long  Absolute position, 1/64 degree
+ */
+long splineKnotPosition(int knot, int servoId, int index)
+{
+  if (knot < 0)
+    return (long)splineStart[servoId] << SPLINE_POSITION_SHIFT;
+  if (knot >= splineCount)
+    knot = splineCount - 1;
+
+  int8_t relative = splineBuffer[SPLINE_HEADER_SIZE + knot * splineStride + 2 + index];
+  return (long)(SERVO_INITPOS_OFFSET[servoId] + relative * SERVO_INVERTED_STATE[servoId]) << SPLINE_POSITION_SHIFT;
+}
+
+/**
+ * Get the Catmull-Rom tangent at a knot, scaled to a segment
+ *
+ * @param knot      Knot, -1 to splineCount - 1. The joints are at rest at either end
+ * @param servoId   Joint in splineMask
+ * @param index     Place of the joint in splineMask
+ * @param duration  ms of the segment the tangent is for
+ * @returns long    Change over the whole segment at the tangent's rate, 1/64 degree
+ */
+long splineTangent(int knot, int servoId, int index, long duration)
+{
+  if (knot < 0 || knot >= splineCount - 1)
+    return 0;
+
+  // From the knot before to the knot after
+  long span = splineKnotTime(knot) + splineKnotTime(knot + 1);
+  long change = splineKnotPosition(knot + 1, servoId, index) - splineKnotPosition(knot - 1, servoId, index);
+  return change * duration / span;
+}
+
+/**
+ * Work out the polynomials for the segment heading for a knot
+ *
+ * @param knot  Knot at the end of the segment
+ */
+void splineStartSegment(int knot)
+{
+  long duration = splineKnotTime(knot);
+  int index = 0;
+  for (int i = 0; i < SERVO_COUNT; i++)
+  {
+    if (!(splineMask & ((uint32_t)1 << i)))
+      continue;
+
+    long p0 = splineKnotPosition(knot - 1, i, index);
+    long p1 = splineKnotPosition(knot, i, index);
+    long m0 = splineTangent(knot - 1, i, index, duration);
+    long m1 = splineTangent(knot, i, index, duration);
+
+    splineCoefficients[i][0] = 2 * p0 - 2 * p1 + m0 + m1;
+    splineCoefficients[i][1] = 3 * p1 - 3 * p0 - 2 * m0 - m1;
+    splineCoefficients[i][2] = m0;
+    splineCoefficients[i][3] = p0;
+    index++;
+  }
+  splineSegment = knot;
+}
+
+/**
+ * Start the uploaded path from where the joints are now. Takes over from any path already running
+ *
+ * @returns bool  False if the path is incomplete or has a knot with no time
+ */
+bool splineRun()
+{
+  splineRunning = false;
+  if (splineLength < SPLINE_HEADER_SIZE)
+  {
+    SPLINE_ERRORS++;
+    return false;
+  }
+
+  splineMask = splineBuffer[0] | ((uint32_t)splineBuffer[1] << 8) | ((uint32_t)splineBuffer[2] << 16);
+  splineCount = splineBuffer[3];
+  int joints = 0;
+  for (int i = 0; i < SERVO_COUNT; i++)
+  {
+    if (splineMask & ((uint32_t)1 << i))
+      joints++;
+  }
+  splineStride = 2 + joints;
+
+  bool valid = splineCount > 0 && joints > 0 && SPLINE_HEADER_SIZE + splineCount * splineStride <= splineLength;
+  for (int knot = 0; valid && knot < splineCount; knot++)
+    valid = splineKnotTime(knot) > 0;
+  if (!valid)
+  {
+    SPLINE_ERRORS++;
+    return false;
+  }
+
+  for (int i = 0; i < SERVO_COUNT; i++)
+    splineStart[i] = SERVO_POSITION[i];
+  splineElapsed = 0;
+  splineSegmentStart = 0;
+  splineLastTick = controlMillis();
+  splineStartSegment(0);
+  splineRunning = true;
+  SPLINES_RUN++;
+  return true;
+}
+
+/** Stop the running path, leaving the joints where they are */
+void splineStop()
+{
+  splineRunning = false;
+}
+
+/**
+ * Write part of the path from an OP_SPLINE_WRITE payload. Writing from offset 0 starts a new path
+ *
+ * @param payload uint8 offset followed by path bytes
+ * @param length  Payload length
+ */
+void splineWrite(const uint8_t payload[], uint8_t length)
+{
+  if (length < 1 || payload[0] + length - 1 > SPLINE_BUFFER_SIZE)
+  {
+    PROTOCOL_ERRORS++;
+    return;
+  }
+
+  if (splineRunning)
+    splineStop();
+  if (payload[0] == 0)
+    splineLength = 0;
+
+  for (int i = 1; i < length; i++)
+    splineBuffer[payload[0] + i - 1] = payload[i];
+  splineLength = max(splineLength, payload[0] + length - 1);
+}
+
+/** Advance the running path. Call every SERVO_FRAME_TIME */
+void splineTick()
+{
+  if (!splineRunning)
+    return;
+
+  unsigned long now = controlMillis();
+  splineElapsed += (now - splineLastTick) * stabilityPace() / STABILITY_PACE_FULL;
+  splineLastTick = now;
+
+  // A long tick can pass through several short segments
+  while (splineElapsed - splineSegmentStart >= (unsigned long)splineKnotTime(splineSegment))
+  {
+    splineSegmentStart += splineKnotTime(splineSegment);
+    if (splineSegment + 1 >= splineCount)
+    {
+      int index = 0;
+      for (int i = 0; i < SERVO_COUNT; i++)
+      {
+        if (splineMask & ((uint32_t)1 << i))
+          servoSet(i, (int)(splineKnotPosition(splineCount - 1, i, index++) >> SPLINE_POSITION_SHIFT), false);
+      }
+      splineRunning = false;
+      return;
+    }
+    splineStartSegment(splineSegment + 1);
+  }
+
+  long s = ((splineElapsed - splineSegmentStart) << SPLINE_TIME_SHIFT) / splineKnotTime(splineSegment);
+  for (int i = 0; i < SERVO_COUNT; i++)
+  {
+    if (!(splineMask & ((uint32_t)1 << i)))
+      continue;
+
+    long *k = splineCoefficients[i];
+    long value = ((((k[0] * s) >> SPLINE_TIME_SHIFT) + k[1]) * s >> SPLINE_TIME_SHIFT) + k[2];
+    value = ((value * s) >> SPLINE_TIME_SHIFT) + k[3];
+    servoSet(i, (int)((value + (1 << (SPLINE_POSITION_SHIFT - 1))) >> SPLINE_POSITION_SHIFT), false);
+  }
+}
+
+#endif
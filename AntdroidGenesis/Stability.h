@@ -0,0 +1,158 @@
+/**
+ * Stability.h
+ * Static stability: how far the centre of mass is inside the polygon of the feet on the ground
+ *
+ * Every control tick the feet are found from SERVO_OUTPUT with legForward(), the ones within
+ * STABILITY_CONTACT_BAND of the lowest foot are taken to be on the ground, and the margin is
+ * the distance from the centre of mass to the nearest edge of their convex hull. It is
+ * negative when the centre of mass is outside, and STABILITY_NO_SUPPORT with fewer than three
+ * feet down. Everything is whole mm, so it stays cheap enough to run every tick.
+ *
+ * The gait asks for the margin a leg would leave before lifting it, and the gait and pose
+ * transitions slow down by stabilityPace() while the margin is under STABILITY_MARGIN_MIN
+ */
+
+#ifndef STABILITY_H
+#define STABILITY_H
+
+#define STABILITY_NO_SUPPORT -1000  // Margin with fewer than three feet on the ground
+#define STABILITY_PACE_FULL 256
+
+/** Feet found from SERVO_OUTPUT on the last tick, mm in the body frame */
+int stabilityFeet[LEG_COUNT][3];
+/** Feet on the ground, leg 0 in bit 0 */
+uint8_t stabilityContacts = 0;
+/** Margin on the last tick, mm */
+int stabilityMargin = 0;
+
+/** Counters reported through telemetry */
+unsigned long STABILITY_LOW_TICKS = 0;    // Ticks with the margin under STABILITY_MARGIN_MIN
+unsigned long STABILITY_REORDERS = 0;     // Leg lifts swapped by the gait to keep the margin
+int STABILITY_WORST_MARGIN = 32767;
+
+/** Integer square root */
+unsigned int stabilitySqrt(unsigned long value)
+{
+  unsigned long root = 0;
+  unsigned long bit = 1UL << 30;
+  while (bit > value)
+    bit >>= 2;
+
+  while (bit)
+  {
+    if (value >= root + bit)
+    {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else
+      root >>= 1;
+    bit >>= 2;
+  }
+  return root;
+}
+
+/** z of the turn from a to b to c seen from above, positive when it turns left */
+long stabilityCross(const int a[], const int b[], const int c[])
+{
+  return (long)(b[0] - a[0]) * (c[1] - a[1]) - (long)(b[1] - a[1]) * (c[0] - a[0]);
+}
+
+/**
+ * Work out the margin for a set of feet on the ground
+ *
+ * @param contacts  Feet on the ground, leg 0 in bit 0
+ * @returns int     Distance from the centre of mass in to the nearest edge of the support polygon, mm
+ */
+int stabilityMarginFor(uint8_t contacts)
+{
+  int count = 0;
+  uint8_t legs[LEG_COUNT];
+  for (int leg = 0; leg < LEG_COUNT; leg++)
+  {
+    if (contacts & (1 << leg))
+      legs[count++] = leg;
+  }
+  if (count < 3)
+    return STABILITY_NO_SUPPORT;
+
+  // Gift wrap the hull anticlockwise from the rearmost foot, there are only a handful of points
+  int start = 0;
+  for (int i = 1; i < count; i++)
+  {
+    if (stabilityFeet[legs[i]][0] < stabilityFeet[legs[start]][0])
+      start = i;
+  }
+
+  const int centre[2] = {STABILITY_COM_X, STABILITY_COM_Y};
+  int margin = 32767;
+  int current = start;
+  for (int edges = 0; edges < count; edges++)
+  {
+    int next = (current + 1) % count;
+    for (int i = 0; i < count; i++)
+    {
+      if (stabilityCross(stabilityFeet[legs[current]], stabilityFeet[legs[next]], stabilityFeet[legs[i]]) < 0)
+        next = i;
+    }
+
+    const int *a = stabilityFeet[legs[current]];
+    const int *b = stabilityFeet[legs[next]];
+    long dx = b[0] - a[0];
+    long dy = b[1] - a[1];
+    unsigned int length = stabilitySqrt(dx * dx + dy * dy);
+    if (length > 0)
+    {
+      int distance = stabilityCross(a, b, centre) / (long)length;
+      if (distance < margin)
+        margin = distance;
+    }
+
+    current = next;
+    if (current == start)
+      break;
+  }
+
+  return margin;
+}
+
+/**
+ * How fast motions should go for the margin there is now
+ *
+ * @returns int Speed, of STABILITY_PACE_FULL
+ */
+int stabilityPace()
+{
+  if (stabilityMargin >= STABILITY_MARGIN_MIN)
+    return STABILITY_PACE_FULL;
+  if (stabilityMargin <= 0)
+    return STABILITY_PACE_MIN;
+  return max(STABILITY_PACE_MIN, (long)STABILITY_PACE_FULL * stabilityMargin / STABILITY_MARGIN_MIN);
+}
+
+/** Find the feet and the margin from what was sent to the servos. Call every SERVO_FRAME_TIME */
+void stabilityTick()
+{
+  int lowest = 32767;
+  for (int leg = 0; leg < LEG_COUNT; leg++)
+  {
+    legForward(leg, SERVO_OUTPUT, stabilityFeet[leg]);
+    if (stabilityFeet[leg][2] < lowest)
+      lowest = stabilityFeet[leg][2];
+  }
+
+  stabilityContacts = 0;
+  for (int leg = 0; leg < LEG_COUNT; leg++)
+  {
+    if (stabilityFeet[leg][2] <= lowest + STABILITY_CONTACT_BAND)
+      stabilityContacts |= 1 << leg;
+  }
+
+  stabilityMargin = stabilityMarginFor(stabilityContacts);
+  if (stabilityMargin < STABILITY_MARGIN_MIN)
+    STABILITY_LOW_TICKS++;
+  if (stabilityMargin < STABILITY_WORST_MARGIN)
+    STABILITY_WORST_MARGIN = stabilityMargin;
+}
+
+#endif
@@ -0,0 +1,227 @@
+/**
+ * Telemetry.h
+ * Runtime counters and status reports, requested over serial with 'q'
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+typedef enum {
+  TELEMETRY_SERVO_UPDATES = 0,
+  TELEMETRY_POSE_STORE = 1,
+  TELEMETRY_UART = 2,
+  TELEMETRY_STREAM = 3,
+  TELEMETRY_COMMANDS = 4,
+  TELEMETRY_PROGRAMS = 5,
+  TELEMETRY_POSES = 6,
+  TELEMETRY_MIXER = 7,
+  TELEMETRY_GUARD = 8,
+  TELEMETRY_GAIT = 9,
+  TELEMETRY_STABILITY = 10,
+  TELEMETRY_FEET = 11,
+  TELEMETRY_KINEMATICS = 12
+} TELEMETRY_REPORT;
+
+/** Print servoUpdate() counters */
+void telemetryServoUpdates()
+{
+  Uart.println("Servo updates performed " + (String)SERVO_UPDATES_PERFORMED +
+                 ", skipped " + (String)SERVO_UPDATES_SKIPPED +
+                 ", deferred " + (String)SERVO_UPDATES_DEFERRED);
+}
+
+/** Print pose store state */
+void telemetryPoseStore()
+{
+  Uart.println("Pose store saves " + (String)POSE_STORE_SAVES +
+                 ", next slot " + (String)poseStoreNextSlot);
+}
+
+/** Print serial receive error counters */
+void telemetryUart()
+{
+  Uart.println("UART overflows " + (String)UART_RX_OVERFLOWS +
+               ", overruns " + (String)UART_RX_OVERRUNS +
+               ", frame errors " + (String)UART_RX_FRAME_ERRORS);
+}
+
+/** Print setpoint stream counters */
+void telemetryStream()
+{
+  Uart.println("Stream setpoints " + (String)STREAM_SETPOINTS +
+               " (" + (String)STREAM_KEYFRAMES + " key, " + (String)STREAM_DELTAS + " delta)" +
+               ", unknown base " + (String)STREAM_UNKNOWN_BASE +
+               ", underruns " + (String)STREAM_UNDERRUNS +
+               ", overruns " + (String)STREAM_OVERRUNS +
+               ", late " + (String)STREAM_LATE +
+               ", packet errors " + (String)PROTOCOL_ERRORS);
+}
+
+/** Print command queue counters */
+void telemetryCommands()
+{
+  Uart.println("Commands queued " + (String)COMMANDS_QUEUED +
+               ", rejected " + (String)COMMANDS_REJECTED +
+               ", failed " + (String)COMMANDS_FAILED +
+               ", waiting " + (String)commandQueueCount +
+               ", worst start error " + (String)COMMANDS_WORST_START_ERROR + "us" +
+               ", pings " + (String)CLOCK_PINGS);
+}
+
+/** Print motion program state */
+void telemetryPrograms()
+{
+  Uart.println("Motion programs run " + (String)MOTION_PROGRAMS_RUN +
+               ", errors " + (String)MOTION_PROGRAM_ERRORS +
+               (motionRunning ? ", running slot " + (String)motionSlot + " at " + (String)motionPc : ", idle"));
+  Uart.println("Splines run " + (String)SPLINES_RUN +
+               ", errors " + (String)SPLINE_ERRORS +
+               (splineRunning ? ", running knot " + (String)splineSegment + " of " + (String)splineCount : ", idle"));
+  Uart.println("Previews run " + (String)PREVIEWS_RUN);
+}
+
+/** Print the pose library */
+void telemetryPoses()
+{
+  char name[POSE_NAME_SIZE + 1];
+  for (int i = 0; i < POSE_COUNT; i++)
+  {
+    if (poseGetName(i, name))
+      Uart.println("Pose " + (String)i + ": " + (String)name);
+  }
+}
+
+/** Print the mixer layers and the composed output */
+void telemetryMixer()
+{
+  for (int i = 0; i < MIXER_LAYER_COUNT; i++)
+  {
+    MIXER_LAYER *layer = &mixerLayers[i];
+    Uart.println("Mixer layer " + (String)i +
+                 ": weight " + (String)layer->weight +
+                 ", joints 0x" + String(layer->mask, HEX));
+  }
+
+  String output = "Output";
+  for (int i = 0; i < SERVO_COUNT; i++)
+    output += " " + (String)SERVO_OUTPUT[i];
+  Uart.println(output);
+}
+
+/** Print joint guard counters */
+void telemetryGuard()
+{
+  Uart.println("Guard clamps: limits " + (String)GUARD_LIMIT_CLAMPS +
+               ", coxae " + (String)GUARD_COXA_CLAMPS +
+               ", envelope " + (String)GUARD_ENVELOPE_CLAMPS);
+}
+
+/** Print the gait plan and counters */
+void telemetryGait()
+{
+  Uart.println("Gait state " + (String)gaitState +
+               ", type " + (String)gaitType +
+               ", blend " + (String)gaitBlend +
+               ", legs 0x" + String(gaitPlan.legs, HEX) +
+               ", cycle " + (String)gaitPlan.cycleTime + "ms" +
+               ", duty " + (String)(gaitPlan.duty * 100 / GAIT_PHASE_ONE) + "%" +
+               ", faults 0x" + String(gaitFaults, HEX) +
+               ", velocity " + (String)(int)gaitVelocityX + "," + (String)(int)gaitVelocityY + "mm/s " +
+               (String)(int)gaitVelocityTurn + "deg/s" +
+               ", steps " + (String)GAIT_STEPS +
+               ", replans " + (String)GAIT_REPLANS +
+               ", IK failures " + (String)GAIT_IK_FAILURES +
+               ", twist timeouts " + (String)GAIT_TWIST_TIMEOUTS +
+               ", blends " + (String)GAIT_BLENDS);
+}
+
+/** Print the stability margin and counters */
+void telemetryStability()
+{
+  Uart.println("Stability margin " + (String)stabilityMargin + "mm" +
+               ", feet down 0x" + String(stabilityContacts, HEX) +
+               ", worst " + (String)STABILITY_WORST_MARGIN + "mm" +
+               ", low ticks " + (String)STABILITY_LOW_TICKS +
+               ", reordered lifts " + (String)STABILITY_REORDERS);
+}
+
+/** Print where each foot is from the positions sent to the servos */
+void telemetryFeet()
+{
+  for (int leg = 0; leg < LEG_COUNT; leg++)
+  {
+    int foot[3];
+    legForward(leg, SERVO_OUTPUT, foot);
+    Uart.println("Foot " + (String)leg +
+                 ": x " + (String)foot[0] +
+                 ", y " + (String)foot[1] +
+                 ", z " + (String)foot[2] + "mm" +
+                 ((stabilityContacts & (1 << leg)) ? ", down" : ", up"));
+  }
+}
+
+/** Print inverse kinematics cache counters */
+void telemetryKinematics()
+{
+  unsigned long lookups = KINEMATICS_CACHE_HITS + KINEMATICS_CACHE_MISSES;
+  Uart.println("IK cache: hits " + (String)KINEMATICS_CACHE_HITS +
+               ", misses " + (String)KINEMATICS_CACHE_MISSES +
+               ", hit rate " + (String)(lookups ? KINEMATICS_CACHE_HITS * 100 / lookups : 0) + "%" +
+               ", " + (String)(KINEMATICS_CACHE_SIZE * sizeof(KINEMATICS_CACHE_ENTRY)) + " bytes");
+}
+
+/**
+ * Print a telemetry report
+ * 
+ * @param report  Report to print, see TELEMETRY_REPORT
+ */
+void telemetryReport(int report)
+{
+  switch (report)
+  {
+  case TELEMETRY_SERVO_UPDATES:
+    telemetryServoUpdates();
+    break;
+  case TELEMETRY_POSE_STORE:
+    telemetryPoseStore();
+    break;
+  case TELEMETRY_UART:
+    telemetryUart();
+    break;
+  case TELEMETRY_STREAM:
+    telemetryStream();
+    break;
+  case TELEMETRY_COMMANDS:
+    telemetryCommands();
+    break;
+  case TELEMETRY_PROGRAMS:
+    telemetryPrograms();
+    break;
+  case TELEMETRY_POSES:
+    telemetryPoses();
+    break;
+  case TELEMETRY_MIXER:
+    telemetryMixer();
+    break;
+  case TELEMETRY_GUARD:
+    telemetryGuard();
+    break;
+  case TELEMETRY_GAIT:
+    telemetryGait();
+    break;
+  case TELEMETRY_STABILITY:
+    telemetryStability();
+    break;
+  case TELEMETRY_FEET:
+    telemetryFeet();
+    break;
+  case TELEMETRY_KINEMATICS:
+    telemetryKinematics();
+    break;
+  default:
+    DEBUG_PRINT("Unknown telemetry report: " + (String)report);
+    break;
+  }
+}
+
+#endif
@@ -90,6 +90,18 @@ ISR(TIMER1_OVF_vect)
     \param initialValue = 0, optional parameter specifing the inital startup
            value */
 void Tlc5940::init(uint16_t initialValue)
+{
+    init(0, 0, initialValue);
+}
+
+/** Pin i/o and Timer setup, starting from a full frame instead of a single
+    value.  BLANK is held high until the frame has been shifted in and
+    latched, so no output ever sees anything but these values.
+    \param initialValues startup values for channels 0 to count - 1
+    \param count number of values in initialValues
+    \param fillValue = 0, startup value for the remaining channels */
+void Tlc5940::init(const uint16_t *initialValues, TLC_CHANNEL_TYPE count,
+                   uint16_t fillValue)
 {
     /* Pin Setup */
     XLAT_DDR |= _BV(XLAT_PIN);
@@ -107,7 +119,8 @@ void Tlc5940::init(uint16_t initialValue)
 
     tlc_shift8_init();
 
-    setAll(initialValue);
+    setAll(fillValue);
+    setChannels(initialValues, 0, count);
     update();
     disable_XLAT_pulses();
     clear_XLAT_interrupt();
@@ -182,12 +195,7 @@ uint8_t Tlc5940::update(void)
     } else {
         pulse_pin(SCLK_PORT, SCLK_PIN);
     }
-    uint8_t *p = tlc_GSData;
-    while (p < tlc_GSData + NUM_TLCS * 24) {
-        tlc_shift8(*p++);
-        tlc_shift8(*p++);
-        tlc_shift8(*p++);
-    }
+    tlc_shiftBuffer(tlc_GSData, NUM_TLCS * 24);
     tlc_needXLAT = 1;
     enable_XLAT_pulses();
     set_XLAT_interrupt();
@@ -248,6 +256,64 @@ void Tlc5940::setAll(uint16_t value)
     }
 }
 
+/** Packs two channels into their 3 byte group, the same layout as #GS_DUO.
+    \param p first byte of the group
+    \param high the odd (higher numbered) channel of the pair
+    \param low the even channel of the pair */
+static inline void tlc_packDuo(uint8_t *p, uint16_t high, uint16_t low)
+{
+    p[0] = high >> 4;
+    p[1] = (uint8_t)(high << 4) | (low >> 8);
+    p[2] = (uint8_t)low;
+}
+
+/** Sets count consecutive channels starting at first from values.  Aligned
+    pairs of channels are written straight into their 3 byte group without
+    reading the shared nibble back, so this is much cheaper than calling
+    set() for each channel.
+    \param values grayscale values (0-4095), values[0] goes to channel first
+    \param first first channel to set (0 to #NUM_TLCS * 16 - 1)
+    \param count number of channels to set.  first + count must not exceed
+           #NUM_TLCS * 16
+    \see set */
+void Tlc5940::setChannels(const uint16_t *values, TLC_CHANNEL_TYPE first,
+                          TLC_CHANNEL_TYPE count)
+{
+    if (!count) {
+        return;
+    }
+    if (first & 1) { // odd channel shares its group with the one below
+        set(first++, *values++);
+        count--;
+    }
+
+    // channels first and first + 1 share the group at the lowest address,
+    // higher channels are stored in the groups before it
+    uint8_t *p = tlc_GSData
+               + ((((uint16_t)(NUM_TLCS * 16 - 2 - first)) * 3) >> 1);
+    TLC_CHANNEL_TYPE pairs = count >> 1;
+#if defined(__AVR__)
+    // two groups per iteration, the loop overhead is as big as the packing
+    for (; pairs >= 2; pairs -= 2) {
+        tlc_packDuo(p, values[1], values[0]);
+        tlc_packDuo(p - 3, values[3], values[2]);
+        p -= 6;
+        values += 4;
+        first += 4;
+    }
+#endif
+    // simple indexed form so host compilers can vectorize it
+    for (TLC_CHANNEL_TYPE i = 0; i < pairs; i++) {
+        tlc_packDuo(p - 3 * i, values[2 * i + 1], values[2 * i]);
+    }
+    values += 2 * pairs;
+    first += 2 * pairs;
+
+    if (count & 1) {
+        set(first, *values);
+    }
+}
+
 #if VPRG_ENABLED
 
 /** \addtogroup ReqVPRG_ENABLED
@@ -309,16 +375,44 @@ void tlc_shift8_init(void)
     SCLK_PORT &= ~_BV(SCLK_PIN);
 }
 
+/** Shifts bit n of byte out on SIN and clocks it in.  sinLow is SIN_PORT
+    with the SIN bit cleared, so the bit is written without a branch or a
+    read-modify-write of the port. */
+#define tlc_shiftBit(byte, n, sinLow) \
+    SIN_PORT = (sinLow) | ((((byte) >> (n)) & 1) << SIN_PIN); \
+    pulse_pin(SCLK_PORT, SCLK_PIN)
+
+/** Shifts a byte out, MSB first, fully unrolled.  SIN_PORT is written as a
+    whole, so interrupts are held off for the 8 bits to keep an ISR from
+    changing other pins on the same port in between. */
+static inline void tlc_bitbang8(uint8_t byte)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint8_t sinLow = SIN_PORT & ~_BV(SIN_PIN);
+    tlc_shiftBit(byte, 7, sinLow);
+    tlc_shiftBit(byte, 6, sinLow);
+    tlc_shiftBit(byte, 5, sinLow);
+    tlc_shiftBit(byte, 4, sinLow);
+    tlc_shiftBit(byte, 3, sinLow);
+    tlc_shiftBit(byte, 2, sinLow);
+    tlc_shiftBit(byte, 1, sinLow);
+    tlc_shiftBit(byte, 0, sinLow);
+    SREG = sreg;
+}
+
 /** Shifts a byte out, MSB first */
 void tlc_shift8(uint8_t byte)
 {
-    for (uint8_t bit = 0x80; bit; bit >>= 1) {
-        if (bit & byte) {
-            SIN_PORT |= _BV(SIN_PIN);
-        } else {
-            SIN_PORT &= ~_BV(SIN_PIN);
-        }
-        pulse_pin(SCLK_PORT, SCLK_PIN);
+    tlc_bitbang8(byte);
+}
+
+/** Shifts out count bytes from data, MSB of data[0] first */
+void tlc_shiftBuffer(const uint8_t *data, uint16_t count)
+{
+    const uint8_t *end = data + count;
+    while (data < end) {
+        tlc_bitbang8(*data++);
     }
 }
 
@@ -346,6 +440,17 @@ void tlc_shift8(uint8_t byte)
         ; // wait for transmission complete
 }
 
+/** Shifts out count bytes from data, MSB of data[0] first */
+void tlc_shiftBuffer(const uint8_t *data, uint16_t count)
+{
+    const uint8_t *end = data + count;
+    while (data < end) {
+        SPDR = *data++;
+        while (!(SPSR & _BV(SPIF)))
+            ;
+    }
+}
+
 #endif
 
 #if VPRG_ENABLED
@@ -404,7 +509,8 @@ Tlc5940 Tlc;
     \ref CoreFunctions "Core Functions" (see the BasicUse Example and Tlc5940):
     - \link Tlc5940::init Tlc.init(int initialValue (0-4095))\endlink - Call this is
             to setup the timers before using any other Tlc functions.
-            initialValue defaults to zero (all channels off).
+            initialValue defaults to zero (all channels off).  An overload
+            takes an array of startup values instead.
     - \link Tlc5940::clear Tlc.clear()\endlink - Turns off all channels
             (Needs Tlc.update())
     - \link Tlc5940::set Tlc.set(uint8_t channel (0-(NUM_TLCS * 16 - 1)),
@@ -412,10 +518,13 @@ Tlc5940 Tlc;
             (Needs Tlc.update())
     - \link Tlc5940::setAll Tlc.setAll(int value(0-4095))\endlink - sets all
             channels to value. (Needs Tlc.update())
+    - \link Tlc5940::setChannels Tlc.setChannels(const uint16_t *values,
+            uint8_t first, uint8_t count)\endlink - sets a run of channels
+            from an array. (Needs Tlc.update())
     - \link Tlc5940::get uint16_t Tlc.get(uint8_t channel)\endlink - returns
             the grayscale data for channel (see set).
     - \link Tlc5940::update Tlc.update()\endlink - Sends the changes from any
-            Tlc.clear's, Tlc.set's, or Tlc.setAll's.
+            Tlc.clear's, Tlc.set's, Tlc.setChannels's, or Tlc.setAll's.
 
     \ref ExtendedFunctions "Extended Functions".  These require an include
     statement at the top of the sketch to use.
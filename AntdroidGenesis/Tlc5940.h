@@ -58,11 +58,15 @@ class Tlc5940
 {
   public:
     void init(uint16_t initialValue = 0);
+    void init(const uint16_t *initialValues, TLC_CHANNEL_TYPE count,
+              uint16_t fillValue = 0);
     void clear(void);
     uint8_t update(void);
     void set(TLC_CHANNEL_TYPE channel, uint16_t value);
     uint16_t get(TLC_CHANNEL_TYPE channel);
     void setAll(uint16_t value);
+    void setChannels(const uint16_t *values, TLC_CHANNEL_TYPE first,
+                     TLC_CHANNEL_TYPE count);
 #if VPRG_ENABLED
     void setAllDC(uint8_t value);
 #endif
@@ -74,6 +78,7 @@ class Tlc5940
 
 void tlc_shift8_init(void);
 void tlc_shift8(uint8_t byte);
+void tlc_shiftBuffer(const uint8_t *data, uint16_t count);
 
 #if VPRG_ENABLED
 void tlc_dcModeStart(void);
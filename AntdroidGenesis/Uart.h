@@ -0,0 +1,183 @@
+/**
+ * Uart.h
+ * Interrupt driven USART0 driver used in place of HardwareSerial
+ *
+ * Bytes are moved between the USART and large ring buffers by interrupts, so receive keeps
+ * working while a blocking move runs. Always runs in double speed (U2X) mode, which gives
+ * usable baud rates up to 1Mbaud on a 16MHz board
+ */
+
+#ifndef UART_H
+#define UART_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+/** Ring buffer sizes. Must be a power of two, at most 256 */
+#define UART_RX_BUFFER_SIZE 256
+#define UART_TX_BUFFER_SIZE 128
+
+/** Baud rates selectable with the 'b' command */
+const unsigned long UART_BAUD_RATES[] = {
+    115200,
+    250000,
+    500000,
+    1000000
+};
+
+volatile uint8_t uartRxBuffer[UART_RX_BUFFER_SIZE];
+volatile uint8_t uartRxHead = 0;
+volatile uint8_t uartRxTail = 0;
+
+volatile uint8_t uartTxBuffer[UART_TX_BUFFER_SIZE];
+volatile uint8_t uartTxHead = 0;
+volatile uint8_t uartTxTail = 0;
+
+/** Receive error counters, reported through telemetry */
+volatile unsigned long UART_RX_OVERFLOWS = 0;    // Ring buffer was full, byte dropped
+volatile unsigned long UART_RX_OVERRUNS = 0;     // USART data overrun, bytes lost before the interrupt ran
+volatile unsigned long UART_RX_FRAME_ERRORS = 0; // Framing or parity error, byte dropped
+
+/** Receive interrupt, moves a byte from the USART into the ring buffer */
+ISR(USART0_RX_vect)
+{
+  uint8_t status = UCSR0A;
+  uint8_t data = UDR0;
+
+  if (status & _BV(DOR0))
+    UART_RX_OVERRUNS++;
+  if (status & (_BV(FE0) | _BV(UPE0)))
+  {
+    UART_RX_FRAME_ERRORS++;
+    return;
+  }
+
+  uint8_t next = (uartRxHead + 1) & (UART_RX_BUFFER_SIZE - 1);
+  if (next == uartRxTail)
+  {
+    UART_RX_OVERFLOWS++;
+    return;
+  }
+  uartRxBuffer[uartRxHead] = data;
+  uartRxHead = next;
+}
+
+/** Send one byte from the ring buffer. Called from the data register empty interrupt */
+void uartTxNext()
+{
+  UDR0 = uartTxBuffer[uartTxTail];
+  UCSR0A = (UCSR0A & _BV(U2X0)) | _BV(TXC0);
+  uartTxTail = (uartTxTail + 1) & (UART_TX_BUFFER_SIZE - 1);
+
+  if (uartTxHead == uartTxTail)
+    UCSR0B &= ~_BV(UDRIE0);
+}
+
+/** Data register empty interrupt */
+ISR(USART0_UDRE_vect)
+{
+  uartTxNext();
+}
+
+/** Print implementation on top of the ring buffers, used like Serial */
+class UartSerial : public Print
+{
+public:
+  /**
+   * Start the USART
+   *
+   * @param baud  Baud rate, up to 1000000
+   */
+  void begin(unsigned long baud)
+  {
+    uint16_t setting = (F_CPU / 4 / baud - 1) / 2;
+
+    UCSR0B = 0;
+    uartRxHead = uartRxTail = 0;
+    uartTxHead = uartTxTail = 0;
+
+    UCSR0A = _BV(U2X0);
+    UBRR0 = setting;
+    written = false;
+    UCSR0C = _BV(UCSZ01) | _BV(UCSZ00); // 8N1
+    UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0);
+  }
+
+  /** Number of received bytes waiting to be read */
+  int available()
+  {
+    return (uint8_t)(uartRxHead - uartRxTail) & (UART_RX_BUFFER_SIZE - 1);
+  }
+
+  /** Next received byte without removing it, or -1 */
+  int peek()
+  {
+    if (uartRxHead == uartRxTail)
+      return -1;
+    return uartRxBuffer[uartRxTail];
+  }
+
+  /** Take the next received byte, or -1 if there is none */
+  int read()
+  {
+    if (uartRxHead == uartRxTail)
+      return -1;
+
+    uint8_t data = uartRxBuffer[uartRxTail];
+    uartRxTail = (uartRxTail + 1) & (UART_RX_BUFFER_SIZE - 1);
+    return data;
+  }
+
+  /**
+   * Queue a byte for sending. Waits while the ring buffer is full
+   *
+   * @param data  Byte to send
+   */
+  size_t write(uint8_t data)
+  {
+    written = true;
+
+    // Nothing queued, send straight away. Clearing TXC0 lets flush() see when it has gone
+    if (uartTxHead == uartTxTail && (UCSR0A & _BV(UDRE0)))
+    {
+      UDR0 = data;
+      UCSR0A = (UCSR0A & _BV(U2X0)) | _BV(TXC0);
+      return 1;
+    }
+
+    uint8_t next = (uartTxHead + 1) & (UART_TX_BUFFER_SIZE - 1);
+    while (next == uartTxTail)
+    {
+      // With interrupts off the buffer would never drain, so send from here
+      if (!(SREG & _BV(SREG_I)) && (UCSR0A & _BV(UDRE0)))
+        uartTxNext();
+    }
+
+    uartTxBuffer[uartTxHead] = data;
+    uartTxHead = next;
+    UCSR0B |= _BV(UDRIE0);
+    return 1;
+  }
+
+  using Print::write;
+
+  /** Wait until everything queued has left the USART */
+  void flush()
+  {
+    if (!written)
+      return;
+
+    while (uartTxHead != uartTxTail || !(UCSR0A & _BV(TXC0)))
+    {
+      if (!(SREG & _BV(SREG_I)) && (UCSR0B & _BV(UDRIE0)) && (UCSR0A & _BV(UDRE0)))
+        uartTxNext();
+    }
+  }
+
+private:
+  bool written = false;
+};
+
+UartSerial Uart;
+
+#endif
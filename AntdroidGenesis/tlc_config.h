@@ -57,8 +57,12 @@
 /** Determines how data should be transfered to the TLCs.  Bit-banging can use
     any two i/o pins, but the hardware SPI is faster.
     - Bit-Bang = TLC_BITBANG
-    - Hardware SPI = TLC_SPI (default) */
+    - Hardware SPI = TLC_SPI (default)
+    Defining it before this file is included overrides it, which is how
+    tools/TlcShiftCheck.cpp builds each mode on the host. */
+#ifndef DATA_TRANSFER_MODE
 #define DATA_TRANSFER_MODE    TLC_SPI
+#endif
 
 /* This include is down here because the files it includes needs the data
    transfer mode */
@@ -53,6 +53,8 @@
 #endif
 
 void tlc_initServos(uint8_t initAngle = 0);
+void tlc_initServos(const uint8_t *initAngles, TLC_CHANNEL_TYPE count);
+void tlc_startServoTimers(void);
 void tlc_setServo(TLC_CHANNEL_TYPE channel, uint8_t angle);
 uint8_t tlc_getServo(TLC_CHANNEL_TYPE channel);
 uint16_t tlc_angleToVal(uint8_t angle);
@@ -62,19 +64,22 @@ uint8_t tlc_valToAngle(uint16_t value);
     \code #include "tlc_servos.h" \endcode
     - void tlc_initServos(uint8_t initAngle = 0) - initializes the tlc for
             servos.
+    - void tlc_initServos(const uint8_t *initAngles, TLC_CHANNEL_TYPE count)
+            - initializes the tlc for servos, each with its own angle.
     - void tlc_setServo(TLC_CHANNEL_TYPE channel, uint8_t angle) - sets a
             servo to an angle
     - uint8_t tlc_getServo(TLC_CHANNEL_TYPE channel) - gets the currently set
             servo angle */
 /* @{ */
 
-/** Initializes the tlc.
-    \param initAngle the initial angle to set all servos to
-            (0 - SERVO_MAX_ANGLE). */
-void tlc_initServos(uint8_t initAngle)
+/** Switches timer1 and timer2 from the Tlc.init() defaults to the servo
+    periods.  BLANK is taken off the timer while it is stopped, so the
+    outputs stay blanked until the timer restarts with the servo period. */
+void tlc_startServoTimers(void)
 {
-    Tlc.init(tlc_angleToVal(initAngle));
     TCCR1B &= ~(_BV(CS12) | _BV(CS11) | _BV(CS10)); // stop timer1
+    uint8_t oldTCCR1A = TCCR1A;
+    TCCR1A = 0; // BLANK follows BLANK_PORT (high) while reconfiguring
     ICR1 = SERVO_TIMER1_TOP;
     TCNT1 = 0;
 #ifdef TLC_ATMEGA_8_H
@@ -90,9 +95,34 @@ void tlc_initServos(uint8_t initAngle)
     OCR2A = SERVO_TIMER2_TOP;
     TCCR2B = oldTCCR2B;
 #endif
+    TCCR1A = oldTCCR1A; // BLANK back on OC1B
     TCCR1B |= _BV(CS11); // start timer1 with div 8 prescale
 }
 
+/** Initializes the tlc.
+    \param initAngle the initial angle to set all servos to
+            (0 - SERVO_MAX_ANGLE). */
+void tlc_initServos(uint8_t initAngle)
+{
+    Tlc.init(tlc_angleToVal(initAngle));
+    tlc_startServoTimers();
+}
+
+/** Initializes the tlc with a separate angle for each servo, so the first
+    pulses already hold the servos where they are meant to be.
+    \param initAngles initial angles (0 - SERVO_MAX_ANGLE) for channels 0 to
+            count - 1.  Remaining channels start at 0.
+    \param count number of angles, at most NUM_TLCS * 16 */
+void tlc_initServos(const uint8_t *initAngles, TLC_CHANNEL_TYPE count)
+{
+    uint16_t values[NUM_TLCS * 16];
+    for (TLC_CHANNEL_TYPE i = 0; i < count; i++) {
+        values[i] = tlc_angleToVal(initAngles[i]);
+    }
+    Tlc.init(values, count, tlc_angleToVal(0));
+    tlc_startServoTimers();
+}
+
 /** Sets a servo on channel to angle.
     \param channel which channel to set
     \param angle (0 - SERVO_MAX_ANGLE) */
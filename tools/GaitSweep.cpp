@@ -0,0 +1,456 @@
+/**
+ * GaitSweep.cpp
+ * Tries the gait in AntdroidGenesis/Gait.h with every combination of step height, stride and
+ * cycle time on the servo model in Simulator.h, and ranks them
+ *
+ * Build:  g++ -std=c++11 -O2 -o GaitSweep GaitSweep.cpp
+ * Usage:  GaitSweep [-j workers] [-n rows] [-w walk] [-a] [-z low:high:step] [-s low:high:step]
+ *                   [-t low:high:step] [-r slew] [-l lag] [-d deadband] > results.txt
+ *
+ *   -z  Step height, mm                  (10:40:2 by default)
+ *   -s  Stride asked of gaitWalk(), mm   (10:40:2)
+ *   -t  Cycle time asked of gaitSetType(), ms (500:2000:100)
+ *   -w  ms of walking measured, after the gait has faded in and got up to speed (5000)
+ *   -a  Walk with every servo enabled, as if none were listed off in SERVO_ENABLED
+ *   -j  Workers, one per core by default
+ *   -n  Rows of the table to print, all by default
+ *   -r, -l and -d set the servo model as in tools/MotionSimulator.cpp
+ *
+ * Every run asks for a tripod, but the planner walks a wave unless all six legs can walk, and
+ * slows the cycle so every swing takes at least GAIT_SWING_TIME_MIN. Each cycle time asked for
+ * is planned before the sweep starts, and cycle times that come out as the same plan are only
+ * walked once. The table shows the gait and cycle time actually walked.
+ *
+ * The robot boots to standing once, then each combination walks forwards from there through
+ * the firmware's gaitTick(), servoUpdate() and stabilityTick() every SERVO_FRAME_TIME. Each run
+ * is scored on the modelled servos, not the commands:
+ *   speed       mm/s the body moved, from the feet that stayed on the ground. Feet come from
+ *               legForward() of the actual positions. Only feet within SPEED_CONTACT_BAND of the
+ *               lowest count, so a low step that skims the ground does not pull the speed down
+ *   margin      Lowest and mean stability margin of the feet down as in Stability.h, mm
+ *   violations  Joints clipped to 0 to 180 or clamped by the joint guard, and foot targets out
+ *               of reach, per second
+ *   current     Mean and peak current estimated from how fast the servos move
+ * and ranked by
+ *   speed - SCORE_MARGIN_WEIGHT * mm the lowest margin is short of STABILITY_MARGIN_MIN
+ *         - SCORE_VIOLATION_WEIGHT * violations - SCORE_CURRENT_WEIGHT * mean current
+ *
+ * The firmware keeps the state of one robot in globals, so the workers are processes rather
+ * than threads, and each run is forked from the standing robot so every run starts the same.
+ * Workers take the next combination from a counter they share as soon as they finish one, so
+ * none of them sits idle while there is work left, and throughput grows with the cores.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Simulator.h"
+
+/** The sweep sets the step height for each run */
+int stepHeight = GAIT_STEP_HEIGHT;
+#undef GAIT_STEP_HEIGHT
+#define GAIT_STEP_HEIGHT stepHeight
+
+#include "../AntdroidGenesis/Kinematics.h"
+#include "../AntdroidGenesis/Stability.h"
+#include "../AntdroidGenesis/Motion.h"
+#include "../AntdroidGenesis/Motions.h"
+#include "../AntdroidGenesis/Gait.h"
+
+#define CURRENT_IDLE 0.01         // A a servo draws holding still
+#define CURRENT_PER_SPEED 0.0015  // A more per degree/s it moves, rough figure for a hobby servo under load
+
+#define SPEED_CONTACT_BAND 2      // mm, feet this close to the lowest are pushing the body
+
+#define SCORE_MARGIN_WEIGHT 2     // Per mm the lowest margin is short of STABILITY_MARGIN_MIN
+#define SCORE_VIOLATION_WEIGHT 10 // Per violation per second
+#define SCORE_CURRENT_WEIGHT 20   // Per A of mean current
+
+/** One combination and how it went, in memory shared with the workers */
+typedef struct {
+  int height;
+  int stride;
+  int cycle;          // Asked of gaitSetType()
+  GAIT_TYPE type;     // Gait the planner chose
+  int legs;           // Legs walking
+  int planned;        // Cycle time the planner chose, ms
+  bool done;          // Set by the run, false if it crashed
+  float speed;
+  int lowestMargin;
+  float meanMargin;
+  float violations;
+  unsigned long ikFailures;
+  float meanCurrent;
+  float peakCurrent;
+  float score;
+} SWEEP_RUN;
+
+/** Current drawn over the run so far */
+double currentTotal = 0;
+float currentPeak = 0;
+
+/** A millisecond passes. Blocking moves call this while they wait, and so does the walk */
+void servoIdle()
+{
+  float before[SERVO_COUNT];
+  for (int i = 0; i < SERVO_COUNT; i++)
+    before[i] = models[i].actual;
+
+  simulatorStep();
+
+  float current = 0;
+  for (int i = 0; i < SERVO_COUNT; i++)
+  {
+    if (SERVO_ENABLED[i])
+      current += CURRENT_IDLE + CURRENT_PER_SPEED * fabs(models[i].actual - before[i]) * 1000;
+  }
+  currentTotal += current;
+  currentPeak = fmax(currentPeak, current);
+}
+
+/** One control tick of walking: the servos move for SERVO_FRAME_TIME, then the gait plans the next frame */
+void walkTick()
+{
+  for (int i = 0; i < SERVO_FRAME_TIME; i++)
+    servoIdle();
+  gaitTick();
+  servoUpdate();
+  stabilityTick();
+}
+
+/**
+ * Find the feet of the modelled servos
+ *
+ * @param feet    Filled with each foot, mm in the body frame
+ */
+void actualFeet(int feet[LEG_COUNT][3])
+{
+  int positions[SERVO_COUNT];
+  for (int i = 0; i < SERVO_COUNT; i++)
+    positions[i] = lround(models[i].actual);
+
+  for (int leg = 0; leg < LEG_COUNT; leg++)
+    legForward(leg, positions, feet[leg]);
+}
+
+/**
+ * Find which feet are on the ground, as stabilityTick() does
+ *
+ * @param feet      Each foot, mm in the body frame
+ * @param band      mm above the lowest foot a foot may be and still be down
+ * @returns uint8_t Feet on the ground, leg 0 in bit 0
+ */
+uint8_t footContacts(int feet[LEG_COUNT][3], int band)
+{
+  int lowest = 32767;
+  for (int leg = 0; leg < LEG_COUNT; leg++)
+    lowest = min(lowest, feet[leg][2]);
+
+  uint8_t contacts = 0;
+  for (int leg = 0; leg < LEG_COUNT; leg++)
+  {
+    if (feet[leg][2] <= lowest + band)
+      contacts |= 1 << leg;
+  }
+  return contacts;
+}
+
+/** Count the bits of a mask */
+int countBits(uint32_t mask)
+{
+  int count = 0;
+  for (; mask; mask &= mask - 1)
+    count++;
+  return count;
+}
+
+/**
+ * Walk one combination from the standing robot and score it
+ *
+ * @param run         Combination, filled with the results
+ * @param walkTime    ms of walking measured
+ */
+void sweepRun(SWEEP_RUN *run, int walkTime)
+{
+  stepHeight = run->height;
+  gaitSetType(GAIT_TRIPOD, run->cycle);
+  if (!gaitWalk(run->stride, 0))
+    return;
+
+  // Fade in and speed up before measuring
+  unsigned long warmup = GAIT_FADE_TIME + 1000 * gaitTargetX / GAIT_ACCEL_MAX + gaitPlan.cycleTime;
+  unsigned long start = simulatorTime;
+  while (simulatorTime - start < warmup)
+    walkTick();
+
+  // What was walked, which the sweep worked out in advance
+  run->legs = countBits(gaitPlan.legs);
+  run->type = run->legs == LEG_COUNT && gaitType == GAIT_TRIPOD ? GAIT_TRIPOD : GAIT_WAVE;
+  run->planned = gaitPlan.cycleTime;
+
+  int feet[LEG_COUNT][3];
+  int lastFeet[LEG_COUNT][3];
+  actualFeet(lastFeet);
+  uint8_t lastPushing = footContacts(lastFeet, SPEED_CONTACT_BAND);
+  unsigned long ikFailures = GAIT_IK_FAILURES;
+  unsigned long violations = 0;
+  double distance = 0;
+  double marginTotal = 0;
+  int lowestMargin = 32767;
+  int ticks = 0;
+  currentTotal = 0;
+  currentPeak = 0;
+  servoClipped = 0;
+
+  start = simulatorTime;
+  while (simulatorTime - start < (unsigned long)walkTime)
+  {
+    walkTick();
+    violations += countBits(guardClamped) + countBits(servoClipped);
+    servoClipped = 0;
+
+    // The body moves the opposite way to the feet that stayed on the ground
+    actualFeet(feet);
+    uint8_t pushing = footContacts(feet, SPEED_CONTACT_BAND);
+    uint8_t stayed = pushing & lastPushing;
+    if (stayed)
+    {
+      double moved = 0;
+      for (int leg = 0; leg < LEG_COUNT; leg++)
+      {
+        if (stayed & (1 << leg))
+          moved += lastFeet[leg][0] - feet[leg][0];
+      }
+      distance += moved / countBits(stayed);
+    }
+
+    // stabilityMarginFor() works on stabilityFeet, borrow it for the actual feet
+    int commandedFeet[LEG_COUNT][3];
+    memcpy(commandedFeet, stabilityFeet, sizeof(commandedFeet));
+    memcpy(stabilityFeet, feet, sizeof(feet));
+    int margin = stabilityMarginFor(footContacts(feet, STABILITY_CONTACT_BAND));
+    memcpy(stabilityFeet, commandedFeet, sizeof(commandedFeet));
+
+    lowestMargin = min(lowestMargin, margin);
+    marginTotal += margin;
+    memcpy(lastFeet, feet, sizeof(feet));
+    lastPushing = pushing;
+    ticks++;
+  }
+
+  float seconds = walkTime / 1000.0;
+  run->speed = distance / seconds;
+  run->lowestMargin = lowestMargin;
+  run->meanMargin = marginTotal / max(ticks, 1);
+  run->ikFailures = GAIT_IK_FAILURES - ikFailures;
+  run->violations = (violations + run->ikFailures) / seconds;
+  run->meanCurrent = currentTotal / (simulatorTime - start);
+  run->peakCurrent = currentPeak;
+  run->score = run->speed - SCORE_MARGIN_WEIGHT * max(0, STABILITY_MARGIN_MIN - lowestMargin) -
+               SCORE_VIOLATION_WEIGHT * run->violations - SCORE_CURRENT_WEIGHT * run->meanCurrent;
+  run->done = true;
+}
+
+/**
+ * Parse a low:high:step range
+ *
+ * @param text    Option value
+ * @param range   Filled with low, high and step
+ * @returns bool  False if it is not a range
+ */
+bool parseRange(const char *text, int range[3])
+{
+  return sscanf(text, "%d:%d:%d", &range[0], &range[1], &range[2]) == 3 && range[2] > 0 && range[0] <= range[1];
+}
+
+/**
+ * Work out the plan gaitWalk() will make for a cycle time, without walking
+ *
+ * @param cycle   Cycle time asked of gaitSetType(), ms
+ * @param run     Filled with the gait, legs and cycle time planned
+ * @returns bool  False if too few legs can walk
+ */
+bool planCycle(int cycle, SWEEP_RUN *run)
+{
+  GAIT_PLAN plan;
+  gaitSetType(GAIT_TRIPOD, cycle);
+  if (!gaitMakePlan(gaitUnusableServos(), &plan))
+    return false;
+
+  run->legs = countBits(plan.legs);
+  run->type = run->legs == LEG_COUNT ? GAIT_TRIPOD : GAIT_WAVE;
+  run->planned = plan.cycleTime;
+  return true;
+}
+
+/** Order runs best first, runs that crashed last */
+bool betterRun(const SWEEP_RUN &a, const SWEEP_RUN &b)
+{
+  if (a.done != b.done)
+    return a.done;
+  return a.score > b.score;
+}
+
+int main(int argc, char **argv)
+{
+  int heights[3] = {10, 40, 2};
+  int strides[3] = {10, 40, 2};
+  int cycles[3] = {500, 2000, 100};
+  int walkTime = 5000;
+  int workers = sysconf(_SC_NPROCESSORS_ONLN);
+  int rows = -1;
+  bool allServos = false;
+
+  bool valid = true;
+  for (int arg = 1; arg < argc && valid; arg++)
+  {
+    char option = argv[arg][0] == '-' ? argv[arg][1] : 0;
+    if (option == 'a')
+    {
+      allServos = true;
+      continue;
+    }
+    if (arg + 1 >= argc)
+    {
+      valid = false;
+      break;
+    }
+
+    const char *value = argv[++arg];
+    if (option == 'z')
+      valid = parseRange(value, heights);
+    else if (option == 's')
+      valid = parseRange(value, strides);
+    else if (option == 't')
+      valid = parseRange(value, cycles);
+    else if (option == 'w')
+      valid = (walkTime = atoi(value)) > 0;
+    else if (option == 'j')
+      valid = (workers = atoi(value)) > 0;
+    else if (option == 'n')
+      rows = atoi(value);
+    else
+      valid = simulatorOption(option, value);
+  }
+  if (!valid)
+  {
+    fprintf(stderr, "Usage: %s [-j workers] [-n rows] [-w walk] [-a] [-z low:high:step] [-s low:high:step]\n"
+                    "       %*s [-t low:high:step] [-r slew] [-l lag] [-d deadband]\n", argv[0], (int)strlen(argv[0]), "");
+    return 2;
+  }
+
+  if (allServos)
+  {
+    for (int i = 0; i < SERVO_COUNT; i++)
+      SERVO_ENABLED[i] = true;
+  }
+  simulatorReset();
+  MotionBootToStand();
+  while (!simulatorSettled())
+    servoIdle();
+
+  // Cycle times the planner makes the same plan of, only the first is walked
+  std::vector<SWEEP_RUN> plans;
+  for (int cycle = cycles[0]; cycle <= cycles[1]; cycle += cycles[2])
+  {
+    SWEEP_RUN plan = {};
+    plan.cycle = cycle;
+    if (!planCycle(cycle, &plan))
+    {
+      fprintf(stderr, "Too few legs can walk\n");
+      return 1;
+    }
+
+    size_t same = 0;
+    while (same < plans.size() && (plans[same].type != plan.type || plans[same].planned != plan.planned))
+      same++;
+    if (same < plans.size())
+      fprintf(stderr, "Cycle %d ms walks the same %d leg %s as %d ms, a %d ms cycle, skipped\n", cycle, plan.legs,
+              plan.type == GAIT_TRIPOD ? "tripod" : "wave", plans[same].cycle, plan.planned);
+    else
+      plans.push_back(plan);
+  }
+
+  std::vector<SWEEP_RUN> combinations;
+  for (int height = heights[0]; height <= heights[1]; height += heights[2])
+  {
+    for (int stride = strides[0]; stride <= strides[1]; stride += strides[2])
+    {
+      for (size_t p = 0; p < plans.size(); p++)
+      {
+        SWEEP_RUN run = plans[p];
+        run.height = height;
+        run.stride = stride;
+        combinations.push_back(run);
+      }
+    }
+  }
+  int count = combinations.size();
+
+  // Results and the next combination to take, shared by every worker
+  size_t shared = sizeof(std::atomic<int>) + count * sizeof(SWEEP_RUN);
+  void *memory = mmap(0, shared, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED)
+  {
+    perror("mmap");
+    return 1;
+  }
+  std::atomic<int> *next = new (memory) std::atomic<int>(0);
+  SWEEP_RUN *runs = (SWEEP_RUN *)(next + 1);
+  std::copy(combinations.begin(), combinations.end(), runs);
+
+  struct timespec started, finished;
+  clock_gettime(CLOCK_MONOTONIC, &started);
+  workers = min(workers, count);
+  for (int w = 0; w < workers; w++)
+  {
+    if (fork() != 0)
+      continue;
+
+    for (int i; (i = next->fetch_add(1)) < count;)
+    {
+      pid_t child = fork();
+      if (child == 0)
+      {
+        sweepRun(&runs[i], walkTime);
+        _exit(0);
+      }
+      if (child > 0)
+        waitpid(child, 0, 0);
+    }
+    _exit(0);
+  }
+  while (wait(0) > 0)
+    ;
+  clock_gettime(CLOCK_MONOTONIC, &finished);
+
+  double wall = finished.tv_sec - started.tv_sec + (finished.tv_nsec - started.tv_nsec) / 1e9;
+  fprintf(stderr, "%d runs on %d workers in %.2fs, %.0f runs/s\n", count, workers, wall, count / wall);
+
+  std::sort(runs, runs + count, betterRun);
+  printf("rank  height stride  gait      cycle   speed  margin   mean  violations  ik fails  current   peak   score\n");
+  for (int i = 0; i < count && (rows < 0 || i < rows); i++)
+  {
+    SWEEP_RUN *run = &runs[i];
+    char gait[16];
+    snprintf(gait, sizeof(gait), "%d %s", run->legs, run->type == GAIT_TRIPOD ? "tripod" : "wave");
+    if (!run->done)
+    {
+      printf("%4d  %6d %6d  %-8s %5d  did not walk\n", i + 1, run->height, run->stride, gait, run->planned);
+      continue;
+    }
+    printf("%4d  %6d %6d  %-8s %5d  %6.1f  %6d %6.1f  %10.1f  %8lu  %7.2f %6.2f %7.1f\n", i + 1,
+           run->height, run->stride, gait, run->planned, run->speed, run->lowestMargin, run->meanMargin,
+           run->violations, run->ikFailures, run->meanCurrent, run->peakCurrent, run->score);
+  }
+
+  munmap(memory, shared);
+  return 0;
+}
@@ -0,0 +1,267 @@
+/**
+ * GuardTables.cpp
+ * Builds AntdroidGenesis/GuardTables.h, the joint limit and collision tables checked by JointGuard.h
+ *
+ * Build:  g++ -std=c++11 -O2 -o GuardTables GuardTables.cpp
+ * Usage:  GuardTables > ../AntdroidGenesis/GuardTables.h
+ *
+ * Everything comes from Configuration.h: leg geometry, initial positions, inverted servos and
+ * the guard limits. Run it again whenever any of those change.
+ *
+ * The tables are indexed by the absolute angle of one joint in GUARD_STEP degree bins and give
+ * the range another joint may take. A range only allows positions that are clear for every
+ * angle in the bin, so the robot never has to work anything out at run time:
+ *   Coxa pairs  For neighbouring legs on one side, the range of the rear coxa for each bin of
+ *               the front coxa. The coxa and femur of each leg are checked as segments seen
+ *               from above, GUARD_LEG_CLEARANCE apart.
+ *   Envelope    For each leg, the range of the tibia for each bin of the femur. The tibia is
+ *               checked against the body, GUARD_BODY_CLEARANCE away.
+ * Soft limits are narrowed where a joint would leave the joint it guards nowhere to go.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../AntdroidGenesis/Configuration.h"
+
+#define GUARD_STEP 5
+#define GUARD_BINS (180 / GUARD_STEP + 1)
+#define LEG_COUNT 6
+#define PAIR_COUNT 4
+
+#define DEG_TO_RAD (M_PI / 180.0)
+
+/** Neighbouring coxae, front then rear. Checked in this order on the robot */
+const int COXA_PAIRS[PAIR_COUNT][2] = {{0, 3}, {3, 6}, {9, 12}, {12, 15}};
+
+int limits[SERVO_COUNT][2];
+int coxaTable[PAIR_COUNT][GUARD_BINS][2];
+int envelopeTable[LEG_COUNT][GUARD_BINS][2];
+
+/** Angle relative to initial of a servo at an absolute position */
+int relative(int servoId, int absolute)
+{
+  return (absolute - SERVO_INITPOS_OFFSET[servoId]) * SERVO_INVERTED_STATE[servoId];
+}
+
+/** Shortest distance from point p to segment ab */
+double pointSegment(double px, double py, double ax, double ay, double bx, double by)
+{
+  double dx = bx - ax, dy = by - ay;
+  double t = ((px - ax) * dx + (py - ay) * dy) / (dx * dx + dy * dy);
+  t = t < 0 ? 0 : (t > 1 ? 1 : t);
+  return hypot(px - ax - t * dx, py - ay - t * dy);
+}
+
+/** Shortest distance between segments ab and cd */
+double segmentSegment(const double a[2], const double b[2], const double c[2], const double d[2])
+{
+  double d1 = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+  double d2 = (b[0] - a[0]) * (d[1] - a[1]) - (b[1] - a[1]) * (d[0] - a[0]);
+  double d3 = (d[0] - c[0]) * (a[1] - c[1]) - (d[1] - c[1]) * (a[0] - c[0]);
+  double d4 = (d[0] - c[0]) * (b[1] - c[1]) - (d[1] - c[1]) * (b[0] - c[0]);
+  if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) && ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0)))
+    return 0;
+
+  double best = pointSegment(a[0], a[1], c[0], c[1], d[0], d[1]);
+  best = fmin(best, pointSegment(b[0], b[1], c[0], c[1], d[0], d[1]));
+  best = fmin(best, pointSegment(c[0], c[1], a[0], a[1], b[0], b[1]));
+  return fmin(best, pointSegment(d[0], d[1], a[0], a[1], b[0], b[1]));
+}
+
+/**
+ * Coxa and femur of a leg seen from above, as the segment from the coxa axis to the knee at full reach
+ *
+ * @param coxa      Coxa servo
+ * @param absolute  Coxa servo position
+ * @param from      Filled with the coxa axis
+ * @param to        Filled with the knee
+ */
+void legSegment(int coxa, int absolute, double from[2], double to[2])
+{
+  int leg = coxa / 3;
+  int side = leg < 3 ? 1 : -1;
+  double yaw = side * (90 - relative(coxa, absolute)) * DEG_TO_RAD;
+
+  from[0] = LEG_MOUNT_X[leg];
+  from[1] = LEG_MOUNT_Y[leg];
+  to[0] = from[0] + (LEG_COXA_LENGTH[leg] + LEG_FEMUR_LENGTH[leg]) * cos(yaw);
+  to[1] = from[1] + (LEG_COXA_LENGTH[leg] + LEG_FEMUR_LENGTH[leg]) * sin(yaw);
+}
+
+/** True if two neighbouring legs are too close */
+bool coxaClash(int front, int frontPos, int rear, int rearPos)
+{
+  double a[2], b[2], c[2], d[2];
+  legSegment(front, frontPos, a, b);
+  legSegment(rear, rearPos, c, d);
+  return segmentSegment(a, b, c, d) < GUARD_LEG_CLEARANCE;
+}
+
+/** True if the tibia of a leg comes too close to the body */
+bool tibiaClash(int femur, int femurPos, int tibia, int tibiaPos)
+{
+  int leg = femur / 3;
+  double femurDown = relative(femur, femurPos) * DEG_TO_RAD;
+  double tibiaDown = femurDown + (LEG_TIBIA_INITIAL_ANGLE + relative(tibia, tibiaPos)) * DEG_TO_RAD;
+
+  // Out from the coxa axis and up, in the plane of the leg
+  double kneeOut = LEG_COXA_LENGTH[leg] + LEG_FEMUR_LENGTH[leg] * cos(femurDown);
+  double kneeUp = -LEG_FEMUR_LENGTH[leg] * sin(femurDown);
+
+  for (int i = 0; i <= 10; i++)
+  {
+    double out = kneeOut + LEG_TIBIA_LENGTH[leg] * cos(tibiaDown) * i / 10;
+    double up = kneeUp - LEG_TIBIA_LENGTH[leg] * sin(tibiaDown) * i / 10;
+    if (out < GUARD_BODY_CLEARANCE && up > -(BODY_DEPTH + GUARD_BODY_CLEARANCE))
+      return true;
+  }
+  return false;
+}
+
+typedef bool (*CLASH)(int, int, int, int);
+
+/**
+ * Work out one row of a table: the range of the guarded joint for one bin of the driving joint
+ *
+ * @param clash   Check for a pair of positions
+ * @param driver  Driving joint
+ * @param bin     Bin of the driving joint
+ * @param guarded Joint the range is for
+ * @param range   Filled with {min, max}
+ * @returns bool  False if no position of the guarded joint is clear
+ */
+bool tableRow(CLASH clash, int driver, int bin, int guarded, int range[2])
+{
+  bool clear[181];
+  for (int pos = 0; pos <= 180; pos++)
+  {
+    clear[pos] = pos >= limits[guarded][0] && pos <= limits[guarded][1];
+    for (int driverPos = bin * GUARD_STEP; clear[pos] && driverPos < (bin + 1) * GUARD_STEP && driverPos <= 180; driverPos++)
+      clear[pos] = !clash(driver, driverPos, guarded, pos);
+  }
+
+  // The clear stretch nearest the initial position of the guarded joint
+  int initial = SERVO_INITPOS_OFFSET[guarded];
+  for (int distance = 0; distance <= 180; distance++)
+  {
+    int pos = -1;
+    if (initial - distance >= 0 && clear[initial - distance])
+      pos = initial - distance;
+    else if (initial + distance <= 180 && clear[initial + distance])
+      pos = initial + distance;
+    if (pos < 0)
+      continue;
+
+    range[0] = range[1] = pos;
+    while (range[0] > 0 && clear[range[0] - 1])
+      range[0]--;
+    while (range[1] < 180 && clear[range[1] + 1])
+      range[1]++;
+    return true;
+  }
+
+  // Nothing is clear, leave the guarded joint to its soft limits
+  range[0] = limits[guarded][0];
+  range[1] = limits[guarded][1];
+  return false;
+}
+
+/**
+ * Fill a table, and narrow the soft limits of the driving joint to the bins where the guarded joint has somewhere to go
+ */
+void buildTable(CLASH clash, int driver, int guarded, int table[GUARD_BINS][2])
+{
+  int low = -1, high = -1;
+  for (int bin = 0; bin < GUARD_BINS; bin++)
+  {
+    if (!tableRow(clash, driver, bin, guarded, table[bin]))
+      continue;
+    if (low < 0)
+      low = bin;
+    high = bin;
+  }
+
+  if (low < 0)
+  {
+    fprintf(stderr, "Servo %d leaves servo %d nowhere to go\n", driver, guarded);
+    return;
+  }
+  if (limits[driver][0] < low * GUARD_STEP)
+    limits[driver][0] = low * GUARD_STEP;
+  if (limits[driver][1] > high * GUARD_STEP + GUARD_STEP - 1)
+    limits[driver][1] = high * GUARD_STEP + GUARD_STEP - 1 > 180 ? 180 : high * GUARD_STEP + GUARD_STEP - 1;
+}
+
+void printTable(const char *name, const char *comment, int count, int table[][GUARD_BINS][2])
+{
+  printf("/** %s */\n", comment);
+  printf("const uint8_t %s[%d][GUARD_BINS][2] PROGMEM = {\n", name, count);
+  for (int i = 0; i < count; i++)
+  {
+    printf("    {");
+    for (int bin = 0; bin < GUARD_BINS; bin++)
+      printf("%s{%d, %d}", bin == 0 ? "" : (bin % 8 ? ", " : ",\n     "), table[i][bin][0], table[i][bin][1]);
+    printf("}%s\n", i + 1 < count ? "," : "");
+  }
+  printf("};\n\n");
+}
+
+int main()
+{
+  const int ranges[3][2] = {
+      {GUARD_COXA_MIN, GUARD_COXA_MAX},
+      {GUARD_FEMUR_MIN, GUARD_FEMUR_MAX},
+      {GUARD_TIBIA_MIN, GUARD_TIBIA_MAX}};
+
+  for (int i = 0; i < SERVO_COUNT; i++)
+  {
+    int a = SERVO_INITPOS_OFFSET[i] + ranges[i % 3][0] * SERVO_INVERTED_STATE[i];
+    int b = SERVO_INITPOS_OFFSET[i] + ranges[i % 3][1] * SERVO_INVERTED_STATE[i];
+    limits[i][0] = fmax(0, fmin(a, b));
+    limits[i][1] = fmin(180, fmax(a, b));
+  }
+
+  // Rear pairs first, so a middle coxa is narrowed before it is guarded by the front one
+  for (int p = PAIR_COUNT - 1; p >= 0; p--)
+    buildTable(coxaClash, COXA_PAIRS[p][0], COXA_PAIRS[p][1], coxaTable[p]);
+  for (int leg = 0; leg < LEG_COUNT; leg++)
+    buildTable(tibiaClash, leg * 3 + 1, leg * 3 + 2, envelopeTable[leg]);
+
+  printf("/**\n");
+  printf(" * GuardTables.h\n");
+  printf(" * Joint limit and collision tables for JointGuard.h\n");
+  printf(" *\n");
+  printf(" * Generated by tools/GuardTables.cpp from Configuration.h, do not edit by hand\n");
+  printf(" */\n\n");
+  printf("#ifndef GUARD_TABLES_H\n");
+  printf("#define GUARD_TABLES_H\n\n");
+  printf("#ifdef ARDUINO\n");
+  printf("#include <avr/pgmspace.h>\n");
+  printf("#else\n");
+  printf("#define PROGMEM\n");
+  printf("#define pgm_read_byte(address) (*(const uint8_t *)(address))\n");
+  printf("#endif\n\n");
+  printf("#define GUARD_STEP %d   // Degrees per table bin\n", GUARD_STEP);
+  printf("#define GUARD_BINS %d\n", GUARD_BINS);
+  printf("#define GUARD_COXA_PAIR_COUNT %d\n\n", PAIR_COUNT);
+
+  printf("/** Soft limits, absolute {min, max} per servo */\n");
+  printf("const uint8_t GUARD_LIMITS[%d][2] PROGMEM = {\n", SERVO_COUNT);
+  for (int i = 0; i < SERVO_COUNT; i++)
+    printf("    {%d, %d}%s\n", limits[i][0], limits[i][1], i + 1 < SERVO_COUNT ? "," : "");
+  printf("};\n\n");
+
+  printf("/** Neighbouring coxae, {front, rear} */\n");
+  printf("const uint8_t GUARD_COXA_PAIRS[GUARD_COXA_PAIR_COUNT][2] PROGMEM = {");
+  for (int p = 0; p < PAIR_COUNT; p++)
+    printf("%s{%d, %d}", p ? ", " : "", COXA_PAIRS[p][0], COXA_PAIRS[p][1]);
+  printf("};\n\n");
+
+  printTable("GUARD_COXA_TABLE", "Range of the rear coxa for each bin of the front coxa, one table per pair", PAIR_COUNT, coxaTable);
+  printTable("GUARD_ENVELOPE_TABLE", "Range of the tibia for each bin of the femur, one table per leg", LEG_COUNT, envelopeTable);
+
+  printf("#endif\n");
+  return 0;
+}
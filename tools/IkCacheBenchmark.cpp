@@ -0,0 +1,255 @@
+/**
+ * IkCacheBenchmark.cpp
+ * Replays the foot targets of a walk through legInverseCached() and checks it against solving
+ * every target with legInverse()
+ *
+ * Build:  g++ -std=c++11 -O2 -o IkCacheBenchmark IkCacheBenchmark.cpp
+ *         g++ -std=c++11 -O2 -DKINEMATICS_CACHE_SIZE=128 -o IkCacheBenchmark IkCacheBenchmark.cpp
+ * Usage:  IkCacheBenchmark [-w walk] [-s stride] [-r repeats] [-a]
+ *
+ *   -w  ms of walking recorded in each gait (10000 by default)
+ *   -s  Stride asked of gaitWalk(), mm (30)
+ *   -r  Times the targets are replayed for the timings (20)
+ *   -a  Walk with every servo enabled, as if none were listed off in SERVO_ENABLED, so the
+ *       tripod can be used
+ *
+ * The robot boots to standing on the servo model in Simulator.h and walks forwards asking for
+ * a tripod, then for a wave, and the target of every walking leg is recorded each control tick
+ * in the order gaitWrite() solves them. The gait actually planned is printed for each, since
+ * with fewer than six legs the planner walks a wave whatever is asked for.
+ *
+ * The firmware leaves the cache out unless KINEMATICS_CACHE_SIZE is given. Here it is built
+ * with 64 entries unless another size is given, rounding to KINEMATICS_CACHE_STEP mm as in
+ * Configuration.h, and the targets are replayed from an empty cache. Prints the hit rate, how
+ * many joints come out different from solving the exact target and by how much, which is what
+ * the rounding costs, and the time per target each way. The times are the host's, where trig
+ * is cheap, so they do not show what a hit saves on the robot's AVR: count the cycles of
+ * legInverse() there before building the cache in. Exits with 1 if the cache disagrees with
+ * legInverse() on whether a target can be reached.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+
+#ifndef KINEMATICS_CACHE_SIZE
+#define KINEMATICS_CACHE_SIZE 64
+#endif
+
+#include "Simulator.h"
+#include "../AntdroidGenesis/Kinematics.h"
+#include "../AntdroidGenesis/Stability.h"
+#include "../AntdroidGenesis/Motion.h"
+#include "../AntdroidGenesis/Motions.h"
+#include "../AntdroidGenesis/Gait.h"
+
+#define DIFFERENCE_MAX 4  // Differences of this many degrees and more are counted together
+
+/** A foot target as gaitWrite() solves it */
+typedef struct {
+  int leg;
+  float x;
+  float y;
+  float z;
+} FOOT_TARGET;
+
+/** A millisecond passes. Blocking moves call this while they wait */
+void servoIdle()
+{
+  simulatorStep();
+}
+
+/** One control tick of walking, as in tools/GaitSweep.cpp */
+void walkTick()
+{
+  for (int i = 0; i < SERVO_FRAME_TIME; i++)
+    servoIdle();
+  gaitTick();
+  servoUpdate();
+  stabilityTick();
+}
+
+/**
+ * Record the foot targets of a walk
+ *
+ * @param type    Gait asked for
+ * @param stride  Stride asked of gaitWalk(), mm
+ * @param walk    ms to record for, after the gait has faded in and got up to speed
+ * @param targets Targets are added to this
+ * @returns bool  False if the robot would not walk
+ */
+bool recordWalk(GAIT_TYPE type, int stride, int walk, std::vector<FOOT_TARGET> &targets)
+{
+  simulatorReset();
+  MotionBootToStand();
+  gaitSetType(type, 0);
+  if (!gaitWalk(stride, 0))
+    return false;
+
+  unsigned long warmup = GAIT_FADE_TIME + 1000 * gaitTargetX / GAIT_ACCEL_MAX + gaitPlan.cycleTime;
+  unsigned long start = simulatorTime;
+  while (simulatorTime - start < warmup)
+    walkTick();
+
+  int legs = 0;
+  for (int leg = 0; leg < LEG_COUNT; leg++)
+    legs += (gaitPlan.legs >> leg) & 1;
+  printf("Asked for a %s, walked a %d leg %s with a %u ms cycle\n", type == GAIT_TRIPOD ? "tripod" : "wave",
+         legs, legs == LEG_COUNT && type == GAIT_TRIPOD ? "tripod" : "wave", gaitPlan.cycleTime);
+
+  start = simulatorTime;
+  while (simulatorTime - start < (unsigned long)walk)
+  {
+    walkTick();
+    for (int leg = 0; leg < LEG_COUNT; leg++)
+    {
+      if (gaitPlan.legs & (1 << leg))
+        targets.push_back({leg, gaitFoot[leg][0], gaitFoot[leg][1], gaitFoot[leg][2]});
+    }
+  }
+
+  // Put down and faded out, ready for the next walk
+  gaitStop();
+  while (gaitState != GAIT_IDLE)
+    walkTick();
+  return true;
+}
+
+/** Empty the cache and its counters */
+void clearCache()
+{
+  memset(kinematicsCache, 0, sizeof(kinematicsCache));
+  KINEMATICS_CACHE_HITS = 0;
+  KINEMATICS_CACHE_MISSES = 0;
+}
+
+/** ns since some fixed point */
+double now()
+{
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+/**
+ * Time solving every target
+ *
+ * @param targets Targets
+ * @param repeats Times through them
+ * @param cached  Through legInverseCached() rather than legInverse()
+ * @returns double ns per target
+ */
+double timeTargets(const std::vector<FOOT_TARGET> &targets, int repeats, bool cached)
+{
+  long checksum = 0;
+  clearCache();
+  double start = now();
+  for (int r = 0; r < repeats; r++)
+  {
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+      const FOOT_TARGET *target = &targets[i];
+      int angles[3] = {0, 0, 0};
+      if (cached)
+        legInverseCached(target->leg, target->x, target->y, target->z, angles);
+      else
+        legInverse(target->leg, target->x, target->y, target->z, angles);
+      checksum += angles[0] + angles[1] + angles[2];
+    }
+  }
+  double took = now() - start;
+
+  // Keeps the compiler from dropping the solutions nobody reads
+  if (checksum == 1)
+    printf(" ");
+  return took / ((double)repeats * targets.size());
+}
+
+int main(int argc, char **argv)
+{
+  int walk = 10000;
+  int stride = 30;
+  int repeats = 20;
+
+  bool valid = true;
+  for (int arg = 1; arg < argc && valid; arg++)
+  {
+    char option = argv[arg][0] == '-' ? argv[arg][1] : 0;
+    if (option == 'a')
+    {
+      for (int i = 0; i < SERVO_COUNT; i++)
+        SERVO_ENABLED[i] = true;
+      continue;
+    }
+    if (++arg >= argc)
+    {
+      valid = false;
+      break;
+    }
+
+    const char *value = argv[arg];
+    if (option == 'w')
+      valid = (walk = atoi(value)) > 0;
+    else if (option == 's')
+      stride = atoi(value);
+    else if (option == 'r')
+      valid = (repeats = atoi(value)) > 0;
+    else
+      valid = false;
+  }
+  if (!valid)
+  {
+    fprintf(stderr, "Usage: %s [-w walk] [-s stride] [-r repeats] [-a]\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<FOOT_TARGET> targets;
+  if (!recordWalk(GAIT_TRIPOD, stride, walk, targets) || !recordWalk(GAIT_WAVE, stride, walk, targets))
+  {
+    fprintf(stderr, "The robot would not walk\n");
+    return 1;
+  }
+
+  // Cached against exact, joint by joint
+  long differences[DIFFERENCE_MAX + 1] = {0};
+  long unreachable = 0, disagree = 0;
+  clearCache();
+  for (size_t i = 0; i < targets.size(); i++)
+  {
+    const FOOT_TARGET *target = &targets[i];
+    int exact[3], cached[3];
+    bool reachable = legInverse(target->leg, target->x, target->y, target->z, exact);
+    if (reachable != legInverseCached(target->leg, target->x, target->y, target->z, cached))
+    {
+      disagree++;
+      continue;
+    }
+    if (!reachable)
+    {
+      unreachable++;
+      continue;
+    }
+    for (int j = 0; j < 3; j++)
+      differences[min(abs(exact[j] - cached[j]), DIFFERENCE_MAX)]++;
+  }
+  unsigned long hits = KINEMATICS_CACHE_HITS;
+  unsigned long lookups = KINEMATICS_CACHE_HITS + KINEMATICS_CACHE_MISSES;
+
+  long joints = 3 * (targets.size() - unreachable - disagree);
+  printf("%d entries rounding to %d mm, %d bytes on the host\n", KINEMATICS_CACHE_SIZE, KINEMATICS_CACHE_STEP,
+         (int)sizeof(kinematicsCache));
+  printf("%lu targets, %.1f%% hits, %ld out of reach, %ld disagree on reach\n", lookups,
+         lookups ? 100.0 * hits / lookups : 0.0, unreachable, disagree);
+  printf("Joints against legInverse() of the exact target:\n");
+  for (int d = 0; d <= DIFFERENCE_MAX; d++)
+  {
+    printf("  %s%d degrees  %7ld  %6.2f%%\n", d == DIFFERENCE_MAX ? ">=" : "  ", d, differences[d],
+           joints ? 100.0 * differences[d] / joints : 0.0);
+  }
+
+  double direct = timeTargets(targets, repeats, false);
+  double cached = timeTargets(targets, repeats, true);
+  printf("legInverse()        %7.1f ns/target\n", direct);
+  printf("legInverseCached()  %7.1f ns/target  %.2fx, on the host\n", cached, direct / cached);
+  return disagree ? 1 : 0;
+}
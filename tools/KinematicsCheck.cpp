@@ -0,0 +1,194 @@
+/**
+ * KinematicsCheck.cpp
+ * Checks the fixed point leg kinematics in AntdroidGenesis/Kinematics.h against a double precision model
+ *
+ * Build:  g++ -std=c++11 -O2 -o KinematicsCheck KinematicsCheck.cpp
+ * Usage:  KinematicsCheck [step]
+ *
+ * Every leg is swept through its guard limits from Configuration.h, step degrees at a time on
+ * each joint (1 by default). For each set of joints the foot from legForward() is compared
+ * with the model, and the model's foot is fed back through legInverse() and out through the
+ * model again to see how far the round trip lands from where it started.
+ *
+ * Prints the worst and mean error per axis for each leg and exits with 1 if any of them is
+ * past FORWARD_TOLERANCE or ROUND_TRIP_TOLERANCE. Run it after changing the leg geometry.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../AntdroidGenesis/Configuration.h"
+#include "../AntdroidGenesis/Kinematics.h"
+
+#define FORWARD_TOLERANCE 1.0     // mm on any axis, legForward() rounds once to whole mm
+#define ROUND_TRIP_TOLERANCE 3.0  // mm, legInverse() rounds each joint to a whole degree
+
+#define RAD (M_PI / 180.0)
+
+/** Rotate v about the z axis */
+void rotateZ(double v[3], double degrees)
+{
+  double c = cos(degrees * RAD), s = sin(degrees * RAD);
+  double x = v[0] * c - v[1] * s;
+  v[1] = v[0] * s + v[1] * c;
+  v[0] = x;
+}
+
+/** Rotate v about the y axis, positive tips +x down towards -z */
+void rotateY(double v[3], double degrees)
+{
+  double c = cos(degrees * RAD), s = sin(degrees * RAD);
+  double x = v[0] * c + v[2] * s;
+  v[2] = -v[0] * s + v[2] * c;
+  v[0] = x;
+}
+
+/**
+ * Foot position of a leg by chaining its segments as vectors
+ *
+ * Each segment is laid along +x, tipped down by the angle of the joints before it, turned to
+ * the coxa yaw and added to the end of the one before, starting at the mount point
+ *
+ * @param leg       Leg, in servo order
+ * @param positions Absolute position of every servo
+ * @param foot      Filled with the foot position in mm, body frame
+ */
+void modelForward(int leg, const int positions[], double foot[3])
+{
+  double coxa = legJointAngle(leg * 3, positions[leg * 3]);
+  double femur = legJointAngle(leg * 3 + 1, positions[leg * 3 + 1]);
+  double tibia = legJointAngle(leg * 3 + 2, positions[leg * 3 + 2]);
+  double yaw = legSide(leg) * (90 - coxa);
+
+  const double lengths[3] = {(double)LEG_COXA_LENGTH[leg], (double)LEG_FEMUR_LENGTH[leg], (double)LEG_TIBIA_LENGTH[leg]};
+  const double pitches[3] = {0, femur, femur + LEG_TIBIA_INITIAL_ANGLE + tibia};
+
+  foot[0] = LEG_MOUNT_X[leg];
+  foot[1] = LEG_MOUNT_Y[leg];
+  foot[2] = 0;
+  for (int i = 0; i < 3; i++)
+  {
+    double segment[3] = {lengths[i], 0, 0};
+    rotateY(segment, pitches[i]);
+    rotateZ(segment, yaw);
+    for (int axis = 0; axis < 3; axis++)
+      foot[axis] += segment[axis];
+  }
+}
+
+/** Worst and total error per axis */
+struct ERRORS
+{
+  double worst[3];
+  double total[3];
+  long count;
+};
+
+void addError(ERRORS *errors, const double a[3], const double b[3])
+{
+  for (int axis = 0; axis < 3; axis++)
+  {
+    double error = fabs(a[axis] - b[axis]);
+    errors->worst[axis] = fmax(errors->worst[axis], error);
+    errors->total[axis] += error;
+  }
+  errors->count++;
+}
+
+/** Print one line of errors, returns false if any axis is past tolerance */
+bool printErrors(const char *name, const ERRORS *errors, double tolerance)
+{
+  long count = errors->count > 0 ? errors->count : 1;
+  printf("  %-10s %8ld  worst %5.2f %5.2f %5.2f  mean %5.2f %5.2f %5.2f\n", name, errors->count,
+         errors->worst[0], errors->worst[1], errors->worst[2],
+         errors->total[0] / count, errors->total[1] / count, errors->total[2] / count);
+  return errors->worst[0] <= tolerance && errors->worst[1] <= tolerance && errors->worst[2] <= tolerance;
+}
+
+/** Absolute {min, max} of a servo from the guard limits, within 0 to 180 */
+void servoRange(int servoId, int range[2])
+{
+  const int limits[3][2] = {
+      {GUARD_COXA_MIN, GUARD_COXA_MAX},
+      {GUARD_FEMUR_MIN, GUARD_FEMUR_MAX},
+      {GUARD_TIBIA_MIN, GUARD_TIBIA_MAX}};
+
+  int a = legServoPosition(servoId, limits[servoId % 3][0]);
+  int b = legServoPosition(servoId, limits[servoId % 3][1]);
+  range[0] = (int)fmax(0, fmin(a, b));
+  range[1] = (int)fmin(180, fmax(a, b));
+}
+
+int main(int argc, char **argv)
+{
+  int step = argc > 1 ? atoi(argv[1]) : 1;
+  if (step < 1)
+  {
+    fprintf(stderr, "Usage: %s [step]\n", argv[0]);
+    return 2;
+  }
+
+  bool pass = true;
+  int positions[SERVO_COUNT];
+  for (int i = 0; i < SERVO_COUNT; i++)
+    positions[i] = SERVO_INITPOS_OFFSET[i];
+
+  printf("Errors in mm, x y z\n");
+  for (int leg = 0; leg < LEG_COUNT; leg++)
+  {
+    int ranges[3][2];
+    for (int joint = 0; joint < 3; joint++)
+      servoRange(leg * 3 + joint, ranges[joint]);
+
+    ERRORS forward = {};
+    ERRORS roundTrip = {};
+    long unreachable = 0;
+    int *joints = &positions[leg * 3];
+    for (joints[0] = ranges[0][0]; joints[0] <= ranges[0][1]; joints[0] += step)
+    {
+      for (joints[1] = ranges[1][0]; joints[1] <= ranges[1][1]; joints[1] += step)
+      {
+        for (joints[2] = ranges[2][0]; joints[2] <= ranges[2][1]; joints[2] += step)
+        {
+          double model[3];
+          modelForward(leg, positions, model);
+
+          int fixed[3];
+          legForward(leg, positions, fixed);
+          const double fixedMm[3] = {(double)fixed[0], (double)fixed[1], (double)fixed[2]};
+          addError(&forward, model, fixedMm);
+
+          int angles[3];
+          if (!legInverse(leg, model[0], model[1], model[2], angles))
+          {
+            unreachable++;
+            continue;
+          }
+          int solved[SERVO_COUNT];
+          for (int i = 0; i < SERVO_COUNT; i++)
+            solved[i] = positions[i];
+          for (int joint = 0; joint < 3; joint++)
+            solved[leg * 3 + joint] = angles[joint];
+
+          double back[3];
+          modelForward(leg, solved, back);
+          addError(&roundTrip, model, back);
+        }
+      }
+    }
+
+    printf("Leg %d\n", leg);
+    pass &= printErrors("forward", &forward, FORWARD_TOLERANCE);
+    pass &= printErrors("round trip", &roundTrip, ROUND_TRIP_TOLERANCE);
+    if (unreachable)
+      printf("  %ld points out of reach for legInverse()\n", unreachable);
+
+    for (int joint = 0; joint < 3; joint++)
+      positions[leg * 3 + joint] = SERVO_INITPOS_OFFSET[leg * 3 + joint];
+  }
+
+  printf(pass ? "Pass\n" : "Fail\n");
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+/**
+ * MotionAssembler.cpp
+ * Host side assembler for the motion programs run by AntdroidGenesis/MotionProgram.h
+ *
+ * Build:  g++ -std=c++11 -O2 -o MotionAssembler MotionAssembler.cpp
+ * Usage:  MotionAssembler [-p] [-s slot] [-r slot] program.txt
+ *
+ * Prints the program as hex bytes. With -p it writes binary packets instead, ready to send
+ * to the robot (e.g. > /dev/ttyACM0 after setting the baud rate with stty): the program is
+ * uploaded into the RAM slot, -s also stores it in an EEPROM slot and -r runs a slot.
+ *
+ * One instruction per line, ';' starts a comment:
+ *   group femurs        Select servos: coxae, femurs, tibias, all, or servo numbers "1 4 7"
+ *   set 25              Position relative to initial for the selected servos
+ *   abs 90              Absolute position for the selected servos
+ *   move 500            Move every servo to its set position over 500ms
+ *   wait 200            Wait 200ms
+ *   loop 3              Repeat up to the matching next, 3 times (0 for ever)
+ *   next
+ *   call 2              Run the program in slot 2 (8 for the RAM slot), then carry on
+ *   end                 Added after the last line when missing
+ */
+
+#include "MotionAssembler.h"
+#include "../AntdroidGenesis/Helpers.h"
+
+/** Packet framing and opcodes, see AntdroidGenesis/Protocol.h */
+#define PROTOCOL_SYNC 0xA5
+#define PROTOCOL_MAX_PAYLOAD 64
+#define OP_PROGRAM_WRITE 0x40
+#define OP_PROGRAM_STORE 0x41
+#define OP_PROGRAM_RUN 0x42
+
+/**
+ * Write a packet to stdout
+ *
+ * @param opcode  Packet opcode
+ * @param payload Payload bytes
+ */
+void sendPacket(uint8_t opcode, const std::vector<uint8_t> &payload)
+{
+  uint8_t crc = crc8Update(0xFF, payload.size());
+  crc = crc8Update(crc, opcode);
+
+  putchar(PROTOCOL_SYNC);
+  putchar(payload.size());
+  putchar(opcode);
+  for (uint8_t data : payload)
+  {
+    putchar(data);
+    crc = crc8Update(crc, data);
+  }
+  putchar(crc);
+}
+
+int main(int argc, char **argv)
+{
+  bool packets = false;
+  int storeSlot = -1;
+  int runSlot = -1;
+  const char *path = 0;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "-p"))
+      packets = true;
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+      storeSlot = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+      runSlot = atoi(argv[++i]);
+    else
+      path = argv[i];
+  }
+
+  if (!path || storeSlot >= MOTION_PROGRAM_SLOTS || runSlot > MOTION_PROGRAM_RAM_SLOT)
+  {
+    fprintf(stderr, "Usage: %s [-p] [-s slot] [-r slot] program.txt\n", argv[0]);
+    return 1;
+  }
+
+  FILE *file = fopen(path, "r");
+  if (!file)
+  {
+    perror(path);
+    return 1;
+  }
+  std::vector<uint8_t> program = assemble(file);
+  fclose(file);
+
+  if (!packets)
+  {
+    for (size_t i = 0; i < program.size(); i++)
+      printf("%02x%c", program[i], i + 1 == program.size() ? '\n' : ' ');
+    return 0;
+  }
+
+  for (size_t offset = 0; offset < program.size(); offset += PROTOCOL_MAX_PAYLOAD - 1)
+  {
+    std::vector<uint8_t> payload = {(uint8_t)offset};
+    for (size_t i = offset; i < program.size() && payload.size() < PROTOCOL_MAX_PAYLOAD; i++)
+      payload.push_back(program[i]);
+    sendPacket(OP_PROGRAM_WRITE, payload);
+  }
+  if (storeSlot >= 0)
+    sendPacket(OP_PROGRAM_STORE, {(uint8_t)storeSlot});
+  if (runSlot >= 0)
+    sendPacket(OP_PROGRAM_RUN, {(uint8_t)runSlot});
+  return 0;
+}
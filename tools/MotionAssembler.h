@@ -0,0 +1,172 @@
+/**
+ * MotionAssembler.h
+ * Assembles the motion programs run by AntdroidGenesis/MotionProgram.h
+ *
+ * Used by tools/MotionAssembler.cpp and tools/MotionAssemblerCheck.cpp. The source language is
+ * described in MotionAssembler.cpp. Errors are printed with their line number and exit with 1.
+ */
+
+#ifndef MOTION_ASSEMBLER_H
+#define MOTION_ASSEMBLER_H
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "../AntdroidGenesis/MotionBytecode.h"
+
+/** Number of servos, see AntdroidGenesis/Configuration.h */
+#define SERVO_COUNT 18
+
+/**
+ * Print an error for a source line and exit
+ *
+ * @param line    Line number
+ * @param message Error
+ */
+void fail(int line, const char *message)
+{
+  fprintf(stderr, "line %d: %s\n", line, message);
+  exit(1);
+}
+
+/**
+ * Parse a number operand and check its range
+ *
+ * @param cursor  Text after the mnemonic, moved past the number
+ * @param low     Smallest value allowed
+ * @param high    Largest value allowed
+ * @param line    Line number for errors
+ */
+int operand(const char **cursor, int low, int high, int line)
+{
+  const char *start = *cursor;
+  long value = strtol(start, (char **)cursor, 10);
+  if (*cursor == start)
+    fail(line, "missing number");
+  if (value < low || value > high)
+    fail(line, "number out of range");
+  return value;
+}
+
+/**
+ * Parse the servos of a group instruction
+ *
+ * @param text    Text after the mnemonic
+ * @param line    Line number for errors
+ * @returns       Mask with servo 0 in bit 0
+ */
+uint32_t groupMask(const char *text, int line)
+{
+  while (*text == ' ' || *text == '\t')
+    text++;
+
+  if (!strncmp(text, "all", 3))
+    return (1UL << SERVO_COUNT) - 1;
+
+  // Three servos per leg: coxa, femur, tibia
+  int joint = !strncmp(text, "coxae", 5) ? 0 : !strncmp(text, "femurs", 6) ? 1 : !strncmp(text, "tibias", 6) ? 2 : -1;
+  if (joint >= 0)
+  {
+    uint32_t mask = 0;
+    for (int leg = 0; leg < SERVO_COUNT / 3; leg++)
+      mask |= 1UL << (leg * 3 + joint);
+    return mask;
+  }
+
+  uint32_t mask = 0;
+  const char *cursor = text;
+  while (*cursor)
+  {
+    mask |= 1UL << operand(&cursor, 0, SERVO_COUNT - 1, line);
+    while (*cursor == ' ' || *cursor == '\t' || *cursor == ',')
+      cursor++;
+  }
+  if (!mask)
+    fail(line, "empty group");
+  return mask;
+}
+
+/**
+ * Assemble a program
+ *
+ * @param file    Source
+ * @returns       Program bytes
+ */
+std::vector<uint8_t> assemble(FILE *file)
+{
+  std::vector<uint8_t> program;
+  char text[256];
+  int line = 0;
+  int loops = 0;
+  uint8_t last = 0xFF;
+
+  while (fgets(text, sizeof(text), file))
+  {
+    line++;
+    char *comment = strchr(text, ';');
+    if (comment)
+      *comment = '\0';
+
+    // Drop the line ending, \n or \r\n, and any spaces before it
+    size_t length = strlen(text);
+    while (length > 0 && isspace((unsigned char)text[length - 1]))
+      text[--length] = '\0';
+
+    char mnemonic[16];
+    int used = 0;
+    if (sscanf(text, " %15s%n", mnemonic, &used) != 1)
+      continue;
+    const char *rest = text + used;
+
+    std::vector<uint8_t> instruction;
+    if (!strcmp(mnemonic, "end"))
+      instruction = {MP_END};
+    else if (!strcmp(mnemonic, "group"))
+    {
+      uint32_t mask = groupMask(rest, line);
+      instruction = {MP_GROUP, (uint8_t)mask, (uint8_t)(mask >> 8), (uint8_t)(mask >> 16)};
+    }
+    else if (!strcmp(mnemonic, "set"))
+      instruction = {MP_SET, (uint8_t)operand(&rest, -128, 127, line)};
+    else if (!strcmp(mnemonic, "abs"))
+      instruction = {MP_SET_ABSOLUTE, (uint8_t)operand(&rest, 0, 180, line)};
+    else if (!strcmp(mnemonic, "move") || !strcmp(mnemonic, "wait"))
+    {
+      int time = operand(&rest, 0, 65535, line);
+      instruction = {(uint8_t)(mnemonic[0] == 'm' ? MP_MOVE : MP_WAIT), (uint8_t)time, (uint8_t)(time >> 8)};
+    }
+    else if (!strcmp(mnemonic, "loop"))
+    {
+      if (++loops > MOTION_MAX_DEPTH)
+        fail(line, "loops nested too deep");
+      instruction = {MP_LOOP, (uint8_t)operand(&rest, 0, 255, line)};
+    }
+    else if (!strcmp(mnemonic, "next"))
+    {
+      if (--loops < 0)
+        fail(line, "next without loop");
+      instruction = {MP_NEXT};
+    }
+    else if (!strcmp(mnemonic, "call"))
+      instruction = {MP_CALL, (uint8_t)operand(&rest, 0, MOTION_PROGRAM_RAM_SLOT, line)};
+    else
+      fail(line, "unknown instruction");
+
+    last = instruction[0];
+    program.insert(program.end(), instruction.begin(), instruction.end());
+  }
+
+  if (loops > 0)
+    fail(line, "loop without next");
+  if (last != MP_END)
+    program.push_back(MP_END);
+  if (program.size() > MOTION_PROGRAM_SIZE)
+    fail(line, "program too long");
+  return program;
+}
+
+#endif
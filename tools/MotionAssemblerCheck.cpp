@@ -0,0 +1,88 @@
+/**
+ * MotionAssemblerCheck.cpp
+ * Checks the motion assembler in MotionAssembler.h against hand assembled programs
+ *
+ * Build:  g++ -std=c++11 -O2 -o MotionAssemblerCheck MotionAssemblerCheck.cpp
+ * Usage:  MotionAssemblerCheck
+ *
+ * The same program is assembled from sources written the ways editors save them: lines ending
+ * in \n, in \r\n, the last line with no line ending, and with trailing spaces, tabs and
+ * comments. Every one has to come out as the bytes in EXPECTED. A source the assembler
+ * rejects prints its error and exits with 1, as does one that assembles differently.
+ */
+
+#include "MotionAssembler.h"
+
+/** Source lines, every instruction and every way of naming a group */
+const char *const SOURCE[] = {
+    "group 1 4 7",
+    "set 25",
+    "group femurs",
+    "abs 90",
+    "move 500",
+    "wait 200",
+    "loop 3",
+    "  group 0,2",
+    "  set -10",
+    "  move 250",
+    "next",
+    "call 2",
+    "end"};
+
+const uint8_t EXPECTED[] = {
+    MP_GROUP, 0x92, 0x00, 0x00,
+    MP_SET, 25,
+    MP_GROUP, 0x92, 0x24, 0x01,
+    MP_SET_ABSOLUTE, 90,
+    MP_MOVE, 0xF4, 0x01,
+    MP_WAIT, 200, 0,
+    MP_LOOP, 3,
+    MP_GROUP, 0x05, 0x00, 0x00,
+    MP_SET, (uint8_t)-10,
+    MP_MOVE, 250, 0,
+    MP_NEXT,
+    MP_CALL, 2,
+    MP_END};
+
+/** A way of writing the source out */
+typedef struct {
+  const char *name;
+  const char *ending;     // After every line
+  bool lastEnding;        // After the last line too
+} SOURCE_STYLE;
+
+const SOURCE_STYLE STYLES[] = {
+    {"\\n", "\n", true},
+    {"\\r\\n", "\r\n", true},
+    {"no line ending at the end", "\n", false},
+    {"\\r\\n, none at the end", "\r\n", false},
+    {"trailing spaces", "  \t \n", true},
+    {"trailing comments, \\r\\n", " ; comment\r\n", true}};
+
+int main()
+{
+  int failures = 0;
+  for (size_t s = 0; s < sizeof(STYLES) / sizeof(STYLES[0]); s++)
+  {
+    const SOURCE_STYLE *style = &STYLES[s];
+    FILE *file = tmpfile();
+    size_t lines = sizeof(SOURCE) / sizeof(SOURCE[0]);
+    for (size_t i = 0; i < lines; i++)
+    {
+      fputs(SOURCE[i], file);
+      if (i + 1 < lines || style->lastEnding)
+        fputs(style->ending, file);
+    }
+    rewind(file);
+
+    printf("%-28s", style->name);
+    fflush(stdout);
+    std::vector<uint8_t> program = assemble(file);
+    fclose(file);
+
+    bool same = program.size() == sizeof(EXPECTED) && !memcmp(program.data(), EXPECTED, sizeof(EXPECTED));
+    printf("%s\n", same ? "ok" : "assembled differently");
+    failures += !same;
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,289 @@
+/**
+ * MotionSimulator.cpp
+ * Runs the motions in AntdroidGenesis/Motions.h on the host against a model of each servo
+ *
+ * Build:  g++ -std=c++11 -O2 -o MotionSimulator MotionSimulator.cpp
+ * Usage:  MotionSimulator [-c] [-o trace.bin] [-p period] [-r slew] [-l lag] [-d deadband] [motion ...]
+ *         MotionSimulator -x trace.bin > trace.csv
+ *
+ * The firmware's own Motion.h and Motions.h run on the servo model in Simulator.h. servoIdle()
+ * moves the virtual clock on a millisecond at a time, so every wait in a blocking move takes as
+ * long as on the robot but the whole run takes a moment. The model has a deadband (-d degrees,
+ * 1 by default), a first order lag (-l ms time constant, 30 by default) and a slew rate limit
+ * (-r degrees/s, 600 by default).
+ *
+ * Motions are named as in MOTIONS below, all of them by default. Each one starts from the
+ * initial positions, or with -c from where the one before ended, and runs until it returns and
+ * every servo has settled. Prints, for each motion, how long it took, how much longer the servos
+ * took to settle (+ if they had not after SETTLE_TIME_MAX), and the worst and RMS difference
+ * between commanded and actual position.
+ *
+ * -o writes a trace sampled every -p ms (SERVO_FRAME_TIME by default), little endian:
+ *   "ATRC", uint8 version, uint8 SERVO_COUNT, uint16 sample period (ms)
+ *   then records, each starting with a type byte:
+ *     'M' uint8 length, name      A motion starts, time goes back to 0
+ *     'S' uint32 time (ms), uint8 commanded[SERVO_COUNT], int16 actual[SERVO_COUNT] in 1/16 degree
+ * -x turns a trace into CSV, one row per sample.
+ */
+
+#include <stdio.h>
+#include <vector>
+
+#include "Simulator.h"
+#include "../AntdroidGenesis/Motion.h"
+#include "../AntdroidGenesis/Motions.h"
+
+#define TRACE_VERSION 1
+#define TRACE_ACTUAL_SCALE 16   // Actual positions are traced in 1/16 degree
+#define SETTLE_TIME_MAX 2000    // ms a motion's servos are given to settle once it returns
+
+typedef struct {
+  const char *name;
+  void (*run)();
+} MOTION;
+
+const MOTION MOTIONS[] = {
+    {"boot", MotionBootToStand},
+    {"prepare", MotionPrepareForStand},
+    {"touch", MotionTouchGround},
+    {"up", MotionUpTouchGround},
+    {"push", MotionPushUpright}};
+
+/** Tracking error over the motion being run */
+typedef struct {
+  double squares;
+  long samples;
+  float worst;
+  int worstServo;
+  unsigned long worstTime;
+} TRACKING;
+
+TRACKING tracking;
+
+FILE *trace = 0;
+int tracePeriod = SERVO_FRAME_TIME;
+
+/** Write a little endian value of size bytes to the trace */
+void traceWrite(unsigned long value, int size)
+{
+  for (int i = 0; i < size; i++)
+    fputc((value >> (8 * i)) & 0xFF, trace);
+}
+
+/** Write a sample of every servo to the trace */
+void traceSample()
+{
+  fputc('S', trace);
+  traceWrite(simulatorTime, 4);
+  for (int i = 0; i < SERVO_COUNT; i++)
+    fputc((uint8_t)lround(models[i].commanded), trace);
+  for (int i = 0; i < SERVO_COUNT; i++)
+    traceWrite((uint16_t)(int16_t)lround(models[i].actual * TRACE_ACTUAL_SCALE), 2);
+}
+
+/** Called by servoDelay() while a blocking move waits: a millisecond of virtual time passes */
+void servoIdle()
+{
+  simulatorStep();
+
+  for (int i = 0; i < SERVO_COUNT; i++)
+  {
+    if (!SERVO_ENABLED[i] || !models[i].started)
+      continue;
+
+    float error = fabs(models[i].commanded - models[i].actual);
+    tracking.squares += error * error;
+    tracking.samples++;
+    if (error > tracking.worst)
+    {
+      tracking.worst = error;
+      tracking.worstServo = i;
+      tracking.worstTime = simulatorTime;
+    }
+  }
+
+  if (trace && simulatorTime % tracePeriod == 0)
+    traceSample();
+}
+
+/**
+ * Run one motion and print how it went
+ *
+ * @param motion  Motion to run
+ * @param restart Start from the initial positions rather than where the last motion ended
+ */
+void simulate(const MOTION *motion, bool restart)
+{
+  if (restart)
+  {
+    simulatorReset();
+    allFemureLastPos = 0;
+    allTibiaLastPos = 0;
+  }
+
+  simulatorTime = 0;
+  memset(&tracking, 0, sizeof(tracking));
+  if (trace)
+  {
+    fputc('M', trace);
+    fputc(strlen(motion->name), trace);
+    fputs(motion->name, trace);
+    traceSample();
+  }
+
+  motion->run();
+  unsigned long took = simulatorTime;
+  while (!simulatorSettled() && simulatorTime - took < SETTLE_TIME_MAX)
+    servoIdle();
+
+  printf("%-10s %8lu %9lu%s %9.2f %6d %8lu %8.2f\n", motion->name, took, simulatorTime - took,
+         simulatorSettled() ? " " : "+", tracking.worst, tracking.worstServo, tracking.worstTime,
+         tracking.samples ? sqrt(tracking.squares / tracking.samples) : 0.0);
+}
+
+/** Read a little endian value of size bytes from a trace, false at the end of the file */
+bool traceRead(FILE *in, unsigned long *value, int size)
+{
+  *value = 0;
+  for (int i = 0; i < size; i++)
+  {
+    int c = fgetc(in);
+    if (c == EOF)
+      return false;
+    *value |= (unsigned long)c << (8 * i);
+  }
+  return true;
+}
+
+/**
+ * Print a trace as CSV
+ *
+ * @param path    Trace file
+ * @returns int   Exit status
+ */
+int exportCsv(const char *path)
+{
+  FILE *in = fopen(path, "rb");
+  char magic[4];
+  unsigned long version, servos, period;
+  if (!in || fread(magic, 1, 4, in) != 4 || memcmp(magic, "ATRC", 4) ||
+      !traceRead(in, &version, 1) || !traceRead(in, &servos, 1) || !traceRead(in, &period, 2) ||
+      version != TRACE_VERSION)
+  {
+    fprintf(stderr, "%s: not a trace\n", path);
+    return 1;
+  }
+
+  printf("motion,time");
+  for (unsigned long i = 0; i < servos; i++)
+    printf(",commanded%lu", i);
+  for (unsigned long i = 0; i < servos; i++)
+    printf(",actual%lu", i);
+  printf("\n");
+
+  char name[256] = "";
+  int type;
+  while ((type = fgetc(in)) != EOF)
+  {
+    unsigned long value;
+    if (type == 'M')
+    {
+      if (!traceRead(in, &value, 1) || fread(name, 1, value, in) != value)
+        break;
+      name[value] = '\0';
+    }
+    else if (type == 'S')
+    {
+      if (!traceRead(in, &value, 4))
+        break;
+      printf("%s,%lu", name, value);
+      for (unsigned long i = 0; i < servos && traceRead(in, &value, 1); i++)
+        printf(",%lu", value);
+      for (unsigned long i = 0; i < servos && traceRead(in, &value, 2); i++)
+        printf(",%.2f", (double)(int16_t)value / TRACE_ACTUAL_SCALE);
+      printf("\n");
+    }
+    else
+    {
+      fprintf(stderr, "%s: bad record\n", path);
+      return 1;
+    }
+  }
+
+  fclose(in);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  bool chain = false;
+  const char *tracePath = 0;
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; arg++)
+  {
+    char option = argv[arg][1];
+    if (option == 'c')
+    {
+      chain = true;
+      continue;
+    }
+    if (arg + 1 >= argc)
+      break;
+
+    const char *value = argv[++arg];
+    if (option == 'x')
+      return exportCsv(value);
+    else if (option == 'o')
+      tracePath = value;
+    else if (option == 'p')
+      tracePeriod = atoi(value);
+    else if (!simulatorOption(option, value))
+      break;
+  }
+  if ((arg < argc && argv[arg][0] == '-') || tracePeriod < 1)
+  {
+    fprintf(stderr, "Usage: %s [-c] [-o trace.bin] [-p period] [-r slew] [-l lag] [-d deadband] [motion ...]\n"
+                    "       %s -x trace.bin > trace.csv\n", argv[0], argv[0]);
+    return 2;
+  }
+
+  // Motions named on the command line, or all of them
+  int count = ARRAY_SIZE(MOTIONS);
+  std::vector<const MOTION *> motions(arg < argc ? argc - arg : count);
+  for (size_t i = 0; i < motions.size(); i++)
+  {
+    motions[i] = arg < argc ? 0 : &MOTIONS[i];
+    for (int m = 0; !motions[i] && m < count; m++)
+    {
+      if (!strcmp(MOTIONS[m].name, argv[arg + i]))
+        motions[i] = &MOTIONS[m];
+    }
+    if (!motions[i])
+    {
+      fprintf(stderr, "Unknown motion %s\n", argv[arg + i]);
+      return 2;
+    }
+  }
+
+  if (tracePath)
+  {
+    trace = fopen(tracePath, "wb");
+    if (!trace)
+    {
+      perror(tracePath);
+      return 1;
+    }
+    fputs("ATRC", trace);
+    traceWrite(TRACE_VERSION, 1);
+    traceWrite(SERVO_COUNT, 1);
+    traceWrite(tracePeriod, 2);
+  }
+
+  printf("motion      took ms  settle ms  worst deg  servo  at ms    rms deg\n");
+  for (size_t i = 0; i < motions.size(); i++)
+    simulate(motions[i], i == 0 || !chain);
+
+  if (trace)
+    fclose(trace);
+  return 0;
+}
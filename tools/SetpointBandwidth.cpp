@@ -0,0 +1,260 @@
+/**
+ * SetpointBandwidth.cpp
+ * Measures how much delta frames save over full setpoints on a recorded walk, and checks every
+ * frame comes out of the firmware as it went in
+ *
+ * Build:  g++ -std=c++11 -O2 -o SetpointBandwidth SetpointBandwidth.cpp
+ * Usage:  SetpointBandwidth [-k key interval] [-a ack delay] [-w walk] [-s stride] [-f trace.bin]
+ *
+ *   -k  Keyframe at least every this many frames (50 by default)
+ *   -a  ms from sending a frame to its OP_SETPOINT_ACK reaching the host (40)
+ *   -w  ms of walking recorded (10000)
+ *   -s  Stride asked of gaitWalk(), mm (30)
+ *   -f  Stream the commanded positions in a tools/MotionSimulator.cpp trace instead of a walk
+ *
+ * The robot boots to standing on the servo model in Simulator.h and walks forwards, and the
+ * output of every control tick is recorded. Those frames are encoded with the DELTA_ENCODER
+ * in DeltaCodec.h and fed to the firmware's own streamReceiveKey() and streamReceiveDelta(),
+ * one every SERVO_FRAME_TIME. The acknowledgements it sends go back to the encoder -a ms
+ * later, so periodic keyframes are sent while deltas against older frames are still in
+ * flight, as on the robot.
+ *
+ * Prints the bytes on the wire per frame for OP_SETPOINT and for the keyframes and delta
+ * frames, counting the 4 bytes of packet framing, and what share of a 115200 baud link each
+ * needs. Exits with 1 if the firmware dropped a frame or decoded one differently from what
+ * was sent.
+ */
+
+#include <stdio.h>
+#include <vector>
+
+#include "Simulator.h"
+#include "../AntdroidGenesis/Kinematics.h"
+#include "../AntdroidGenesis/Stability.h"
+#include "../AntdroidGenesis/Motion.h"
+#include "../AntdroidGenesis/Motions.h"
+#include "../AntdroidGenesis/Gait.h"
+
+/** Stands in for the firmware's UART, keeps what the firmware sends */
+class HostUart
+{
+public:
+  void write(uint8_t byte) { sent.push_back(byte); }
+  std::vector<uint8_t> sent;
+};
+
+HostUart Uart;
+
+#include "../AntdroidGenesis/Protocol.h"
+#include "../AntdroidGenesis/DeltaCodec.h"
+#include "../AntdroidGenesis/SetpointStream.h"
+
+#define PACKET_OVERHEAD 4   // Sync, length, opcode and crc around every payload
+#define LINK_BAUD 115200
+#define LINK_BITS 10        // Per byte on the wire, with start and stop bits
+
+/** A millisecond passes. Blocking moves call this while they wait */
+void servoIdle()
+{
+  simulatorStep();
+}
+
+/**
+ * Record a walk, one frame of output per control tick
+ *
+ * @param stride  Stride asked of gaitWalk(), mm
+ * @param walk    ms to walk for
+ * @param frames  Filled with the frames
+ * @returns bool  False if the robot would not walk
+ */
+bool recordWalk(int stride, int walk, std::vector<std::vector<uint8_t> > &frames)
+{
+  simulatorReset();
+  MotionBootToStand();
+  if (!gaitWalk(stride, 0))
+    return false;
+
+  for (unsigned long start = simulatorTime; simulatorTime - start < (unsigned long)walk;)
+  {
+    for (int i = 0; i < SERVO_FRAME_TIME; i++)
+      servoIdle();
+    gaitTick();
+    servoUpdate();
+    stabilityTick();
+
+    std::vector<uint8_t> frame(SERVO_COUNT);
+    for (int i = 0; i < SERVO_COUNT; i++)
+      frame[i] = SERVO_OUTPUT[i];
+    frames.push_back(frame);
+  }
+  return true;
+}
+
+/**
+ * Read the commanded positions from a tools/MotionSimulator.cpp trace
+ *
+ * @param path    Trace file
+ * @param frames  Filled with one frame per sample
+ * @returns bool  False if it is not a trace
+ */
+bool readTrace(const char *path, std::vector<std::vector<uint8_t> > &frames)
+{
+  FILE *in = fopen(path, "rb");
+  uint8_t header[8];
+  if (!in || fread(header, 1, 8, in) != 8 || memcmp(header, "ATRC", 4) || header[4] != 1 ||
+      header[5] != SERVO_COUNT)
+    return false;
+
+  int type;
+  while ((type = fgetc(in)) != EOF)
+  {
+    if (type == 'M')
+    {
+      int length = fgetc(in);
+      if (length == EOF || fseek(in, length, SEEK_CUR))
+        return false;
+      continue;
+    }
+
+    uint8_t sample[4 + 3 * SERVO_COUNT];
+    if (type != 'S' || fread(sample, 1, sizeof(sample), in) != sizeof(sample))
+      return false;
+    frames.push_back(std::vector<uint8_t>(sample + 4, sample + 4 + SERVO_COUNT));
+  }
+  fclose(in);
+  return true;
+}
+
+/** Take the sequences out of the OP_SETPOINT_ACK packets the firmware has sent */
+void takeAcks(std::vector<uint8_t> &acks)
+{
+  std::vector<uint8_t> &sent = Uart.sent;
+  for (size_t i = 0; i + 3 < sent.size(); i += PACKET_OVERHEAD + sent[i + 1])
+  {
+    if (sent[i] == PROTOCOL_SYNC && sent[i + 2] == OP_SETPOINT_ACK)
+      acks.push_back(sent[i + 3]);
+  }
+  sent.clear();
+}
+
+int main(int argc, char **argv)
+{
+  int keyInterval = 50;
+  int ackDelay = 40;
+  int walk = 10000;
+  int stride = 30;
+  const char *tracePath = 0;
+
+  bool valid = true;
+  for (int arg = 1; arg < argc && valid; arg += 2)
+  {
+    char option = argv[arg][0] == '-' ? argv[arg][1] : 0;
+    if (arg + 1 >= argc)
+    {
+      valid = false;
+      break;
+    }
+
+    const char *value = argv[arg + 1];
+    if (option == 'k')
+      valid = (keyInterval = atoi(value)) > 0;
+    else if (option == 'a')
+      valid = (ackDelay = atoi(value)) >= 0;
+    else if (option == 'w')
+      valid = (walk = atoi(value)) > 0;
+    else if (option == 's')
+      stride = atoi(value);
+    else if (option == 'f')
+      tracePath = value;
+    else
+      valid = false;
+  }
+  if (!valid)
+  {
+    fprintf(stderr, "Usage: %s [-k key interval] [-a ack delay] [-w walk] [-s stride] [-f trace.bin]\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<std::vector<uint8_t> > frames;
+  if (tracePath && !readTrace(tracePath, frames))
+  {
+    fprintf(stderr, "%s: not a trace\n", tracePath);
+    return 1;
+  }
+  if (!tracePath && !recordWalk(stride, walk, frames))
+  {
+    fprintf(stderr, "The robot would not walk\n");
+    return 1;
+  }
+
+  DELTA_ENCODER encoder;
+  deltaEncoderInit(&encoder, SERVO_COUNT, keyInterval);
+
+  // Acknowledgements on their way back, and when each reaches the host
+  std::vector<uint8_t> inFlight;
+  std::vector<unsigned long> arrives;
+
+  long keys = 0, deltas = 0, keyBytes = 0, deltaBytes = 0, wrong = 0;
+  simulatorTime = 0;
+  for (size_t f = 0; f < frames.size(); f++)
+  {
+    for (size_t i = 0; i < inFlight.size();)
+    {
+      if (arrives[i] > simulatorTime)
+      {
+        i++;
+        continue;
+      }
+      deltaEncoderAck(&encoder, inFlight[i]);
+      inFlight.erase(inFlight.begin() + i);
+      arrives.erase(arrives.begin() + i);
+    }
+
+    uint8_t payload[4 + (SERVO_COUNT + 7) / 8 + 2 * SERVO_COUNT];
+    bool key;
+    unsigned long dropped = STREAM_UNKNOWN_BASE + PROTOCOL_ERRORS;
+    int length = deltaEncoderFrame(&encoder, simulatorTime, frames[f].data(), payload, &key);
+    if (key)
+    {
+      streamReceiveKey(payload, length);
+      keys++;
+      keyBytes += length + PACKET_OVERHEAD;
+    }
+    else
+    {
+      streamReceiveDelta(payload, length);
+      deltas++;
+      deltaBytes += length + PACKET_OVERHEAD;
+    }
+
+    // A frame the firmware applied is its newest reference
+    uint8_t newest = (streamReferenceNext + DELTA_HISTORY - 1) % DELTA_HISTORY;
+    if (STREAM_UNKNOWN_BASE + PROTOCOL_ERRORS == dropped &&
+        (streamReferenceSequence[newest] != payload[0] || memcmp(streamReference[newest], frames[f].data(), SERVO_COUNT)))
+      wrong++;
+
+    std::vector<uint8_t> acks;
+    takeAcks(acks);
+    for (size_t i = 0; i < acks.size(); i++)
+    {
+      inFlight.push_back(acks[i]);
+      arrives.push_back(simulatorTime + ackDelay);
+    }
+    simulatorTime += SERVO_FRAME_TIME;
+  }
+
+  long count = frames.size();
+  double full = 2 + SERVO_COUNT + PACKET_OVERHEAD;
+  double coded = (double)(keyBytes + deltaBytes) / count;
+  double link = LINK_BAUD / LINK_BITS * SERVO_FRAME_TIME / 1000.0;
+  printf("%ld frames every %d ms, keyframe every %d, acknowledged after %d ms\n", count,
+         SERVO_FRAME_TIME, keyInterval, ackDelay);
+  printf("OP_SETPOINT       %6.1f bytes/frame  %5.1f%% of %d baud\n", full, 100 * full / link, LINK_BAUD);
+  printf("key and delta     %6.1f bytes/frame  %5.1f%% of %d baud  %.0f%% smaller\n", coded,
+         100 * coded / link, LINK_BAUD, 100 * (1 - coded / full));
+  printf("  %ld keyframes   %6.1f bytes each\n", keys, keys ? (double)keyBytes / keys : 0.0);
+  printf("  %ld deltas      %6.1f bytes each\n", deltas, deltas ? (double)deltaBytes / deltas : 0.0);
+  printf("Dropped for an unknown base %lu, decode errors %lu, applied wrong %ld\n", STREAM_UNKNOWN_BASE,
+         PROTOCOL_ERRORS, wrong);
+  return STREAM_UNKNOWN_BASE || PROTOCOL_ERRORS || wrong ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+/**
+ * Simulator.h
+ * Runs firmware motion code on the host: stand-ins for the Arduino core and a model of each servo
+ *
+ * Used by tools/MotionSimulator.cpp and tools/GaitSweep.cpp. The firmware's Servos.h, Mixer.h
+ * and the headers they need are built in with the onboard driver, and Servo::write() drives
+ * the model instead of a pin. millis() is a virtual clock moved on by simulatorStep(), a
+ * millisecond at a time. A tool defines servoIdle(), which blocking moves call while they
+ * wait, and has it call simulatorStep().
+ *
+ * A modelled servo does not move while it is within the deadband of its command. Otherwise it
+ * closes on the command with a first order lag, no faster than the slew rate.
+ *
+ * Like the Arduino core this defines min, max and constrain as macros, so include any C++
+ * standard headers first.
+ */
+
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** What the firmware needs from the Arduino core */
+#define SERVO_DRIVER_ONBOARD
+#define DEBUG_PRINT(x)
+#define DEBUG_SERVO(servo, position)
+#define constrain(x, low, high) ((x) < (low) ? (low) : ((x) > (high) ? (high) : (x)))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+unsigned long simulatorTime = 0;
+
+unsigned long millis()
+{
+  return simulatorTime;
+}
+
+/** Stands in for the Arduino Servo library */
+class Servo
+{
+public:
+  bool attached() { return isAttached; }
+  void attach(int) { isAttached = true; }
+  void write(int pos);
+
+private:
+  bool isAttached = false;
+};
+
+#include "../AntdroidGenesis/Configuration.h"
+#include "../AntdroidGenesis/Helpers.h"
+#include "../AntdroidGenesis/Servos.h"
+#include "../AntdroidGenesis/JointGuard.h"
+#include "../AntdroidGenesis/Mixer.h"
+
+/** Servo model settings, tools set them from the -r, -l and -d options */
+float slewRate = 600;   // degrees/s
+float lag = 30;         // ms time constant
+float deadband = 1;     // degrees
+
+typedef struct {
+  bool started;         // Written to at least once
+  float commanded;      // Degrees
+  float actual;
+} SERVO_MODEL;
+
+SERVO_MODEL models[SERVO_COUNT];
+
+/** Drive the model of the servo being written */
+void Servo::write(int pos)
+{
+  SERVO_MODEL *model = &models[this - SERVO];
+  model->commanded = pos;
+  if (!model->started)
+    model->actual = pos;
+  model->started = true;
+}
+
+/** Let a millisecond pass: move the clock and every servo model on */
+void simulatorStep()
+{
+  simulatorTime++;
+  for (int i = 0; i < SERVO_COUNT; i++)
+  {
+    SERVO_MODEL *model = &models[i];
+    float error = model->commanded - model->actual;
+    if (!model->started || fabs(error) <= deadband)
+      continue;
+
+    float step = error / fmax(lag, 1);
+    float fastest = slewRate / 1000;
+    model->actual += fmax(-fastest, fmin(fastest, step));
+  }
+}
+
+/** Put every servo back at its initial position, at rest, and the clock back to 0 */
+void simulatorReset()
+{
+  memset(models, 0, sizeof(models));
+  SERVO_DIRTY = 0;
+  initializeServos();
+  simulatorTime = 0;
+}
+
+/** True once every servo is within its deadband */
+bool simulatorSettled()
+{
+  for (int i = 0; i < SERVO_COUNT; i++)
+  {
+    if (SERVO_ENABLED[i] && models[i].started && fabs(models[i].commanded - models[i].actual) > deadband)
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Take a servo model option
+ *
+ * @param option  Option letter: r slew rate, l lag, d deadband
+ * @param value   Option value
+ * @returns bool  False if the option is not a servo model one
+ */
+bool simulatorOption(char option, const char *value)
+{
+  if (option == 'r')
+    slewRate = atof(value);
+  else if (option == 'l')
+    lag = atof(value);
+  else if (option == 'd')
+    deadband = atof(value);
+  else
+    return false;
+  return slewRate > 0;
+}
+
+#endif
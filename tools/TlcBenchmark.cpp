@@ -0,0 +1,133 @@
+/**
+ * TlcBenchmark.cpp
+ * Times Tlc5940::setChannels() against setting the same channels one at a time with set()
+ *
+ * Build:  g++ -std=c++11 -O2 -I. -o TlcBenchmark TlcBenchmark.cpp
+ * Usage:  TlcBenchmark [frames]
+ *
+ * The TLC5940 library is built on the host against the register stand-ins in avr/, with
+ * NUM_TLCS from tlc_config.h. First setChannels() is checked against looping set() for every
+ * first channel and count, from a random grayscale buffer each time, and the run exits with
+ * 1 if any byte of tlc_GSData differs. Then a whole frame of changing values is written
+ * frames times each way (100000 by default) and the time per frame printed.
+ *
+ * __AVR__ is defined so setChannels() takes the loop built for the robot. The times are still
+ * the host's, so compare the two rather than reading the nanoseconds as the robot's.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Take the loop in setChannels() that the robot runs, not the one for other builds
+#define __AVR__
+#include "../AntdroidGenesis/Tlc5940.cpp"
+
+#define CHANNELS (NUM_TLCS * 16)
+
+/** Fill the grayscale buffer with random bytes */
+void randomFill()
+{
+  for (int i = 0; i < NUM_TLCS * 24; i++)
+    tlc_GSData[i] = rand();
+}
+
+/**
+ * Check setChannels() against set() for every run of channels
+ *
+ * @returns int   Runs that differed
+ */
+int checkChannels()
+{
+  uint16_t values[CHANNELS];
+  uint8_t start[NUM_TLCS * 24];
+  uint8_t expected[NUM_TLCS * 24];
+  int failures = 0;
+  for (int first = 0; first < CHANNELS; first++)
+  {
+    for (int count = 0; first + count <= CHANNELS; count++)
+    {
+      for (int i = 0; i < count; i++)
+        values[i] = rand() & 4095;
+
+      randomFill();
+      memcpy(start, tlc_GSData, sizeof(start));
+      for (int i = 0; i < count; i++)
+        Tlc.set(first + i, values[i]);
+      memcpy(expected, tlc_GSData, sizeof(expected));
+
+      memcpy(tlc_GSData, start, sizeof(start));
+      Tlc.setChannels(values, first, count);
+      if (memcmp(expected, tlc_GSData, sizeof(expected)))
+      {
+        printf("first %d count %d differs from set()\n", first, count);
+        failures++;
+      }
+    }
+  }
+  return failures;
+}
+
+/** ns since some fixed point */
+double now()
+{
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+/**
+ * Time writing whole frames
+ *
+ * @param frames  Frames to write
+ * @param bulk    With setChannels() rather than set()
+ * @returns double ns per frame
+ */
+double timeFrames(long frames, bool bulk)
+{
+  uint16_t values[CHANNELS];
+  unsigned long checksum = 0;
+  double start = now();
+  for (long frame = 0; frame < frames; frame++)
+  {
+    for (int i = 0; i < CHANNELS; i++)
+      values[i] = (frame + i * 97) & 4095;
+
+    if (bulk)
+      Tlc.setChannels(values, 0, CHANNELS);
+    else
+    {
+      for (int i = 0; i < CHANNELS; i++)
+        Tlc.set(i, values[i]);
+    }
+    checksum += tlc_GSData[frame % (NUM_TLCS * 24)];
+  }
+  double took = now() - start;
+
+  // Keeps the compiler from dropping the frames nobody reads
+  if (checksum == 1)
+    printf(" ");
+  return took / frames;
+}
+
+int main(int argc, char **argv)
+{
+  long frames = argc > 1 ? atol(argv[1]) : 100000;
+  if (frames < 1)
+  {
+    fprintf(stderr, "Usage: %s [frames]\n", argv[0]);
+    return 2;
+  }
+
+  srand(1);
+  int failures = checkChannels();
+  printf("%d TLC5940, %d channels, setChannels() %s set()\n", NUM_TLCS, CHANNELS,
+         failures ? "DIFFERS from" : "matches");
+
+  double single = timeFrames(frames, false);
+  double bulk = timeFrames(frames, true);
+  printf("set()          %8.1f ns/frame\n", single);
+  printf("setChannels()  %8.1f ns/frame  %.2fx\n", bulk, single / bulk);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,142 @@
+/**
+ * TlcShiftCheck.cpp
+ * Checks the bits the TLC5940 library clocks out against what the chips should receive
+ *
+ * Build:  g++ -std=c++11 -O2 -I. -o TlcShiftCheck TlcShiftCheck.cpp
+ *         g++ -std=c++11 -O2 -I. -DDATA_TRANSFER_MODE=TLC_SPI -o TlcShiftCheckSpi TlcShiftCheck.cpp
+ * Usage:  TlcShiftCheck [frames]
+ *
+ * The library is built on the host against the register stand-ins in avr/, bit-banged by
+ * default or with the SPI module when DATA_TRANSFER_MODE is given. Every register write is
+ * watched: a rising edge on SCLK takes the SIN pin as the next bit, and a byte written to SPDR
+ * is sent a bit at a time, MSB first, as the SPI module does. Both builds are held to the same
+ * stream, so the bit-banged output is checked against the SPI path.
+ *
+ * Tlc.update() shifts out frames of random grayscale data (1000 by default). For each frame:
+ *   - The chips get the extra SCLK pulse and then every bit of tlc_GSData, MSB of byte 0 first
+ *   - The other pins on SIN's port are left alone. Between writes, while interrupts are on, a
+ *     stand-in interrupt sometimes toggles ISR_PIN, so a whole port write made from a copy
+ *     taken before the interrupt would put the pin back and be caught
+ *   - SCLK is low and interrupts are on again afterwards
+ * tlc_shift8() is checked the same way with random bytes. Exits with 1 if anything is off.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#ifndef DATA_TRANSFER_MODE
+#define DATA_TRANSFER_MODE TLC_BITBANG
+#endif
+
+#include "../AntdroidGenesis/Tlc5940.cpp"
+
+#define ISR_PIN PB7     // Not used by the library, stands for a pin an interrupt drives
+#define ISR_CHANCE 7    // One write in this many is followed by the interrupt
+
+/** Bits the chips have clocked in */
+std::vector<uint8_t> received;
+
+/** What the pins the library does not own should be */
+uint8_t otherPins = 0;
+#define OTHER_MASK ((uint8_t)~(_BV(SIN_PIN) | _BV(SCLK_PIN)))
+
+long interrupts = 0;
+
+/** Watches every register write, see registerWritten in avr/io.h */
+void watchRegisters(const void *reg, unsigned before)
+{
+  if (reg == &SCLK_PORT && !(before & _BV(SCLK_PIN)) && (SCLK_PORT & _BV(SCLK_PIN)))
+    received.push_back((SIN_PORT >> SIN_PIN) & 1);
+
+  if (reg == &SPDR)
+  {
+    for (int bit = 7; bit >= 0; bit--)
+      received.push_back((SPDR >> bit) & 1);
+    SPSR.value |= _BV(SPIF);
+  }
+
+  if ((SREG & _BV(7)) && rand() % ISR_CHANCE == 0)
+  {
+    SIN_PORT.value ^= _BV(ISR_PIN);
+    otherPins ^= _BV(ISR_PIN);
+    interrupts++;
+  }
+}
+
+/**
+ * Check what the chips received and the state of the pins
+ *
+ * @param what    Name for the report
+ * @param data    Bytes that should have been received, after skip bits
+ * @param count   Number of bytes
+ * @param skip    Bits clocked in ahead of data, whatever their value
+ * @returns bool  True if it all matches
+ */
+bool checkReceived(const char *what, const uint8_t *data, int count, int skip)
+{
+  bool ok = (int)received.size() == skip + 8 * count;
+  for (int i = 0; ok && i < 8 * count; i++)
+    ok = received[skip + i] == ((data[i / 8] >> (7 - i % 8)) & 1);
+  if (!ok)
+    printf("%s: %d bits received, the data does not match\n", what, (int)received.size());
+
+  if ((SIN_PORT & OTHER_MASK) != otherPins)
+  {
+    printf("%s: other pins on the port changed from %02X to %02X\n", what, otherPins,
+           SIN_PORT & OTHER_MASK);
+    ok = false;
+  }
+  if (SCLK_PORT & _BV(SCLK_PIN))
+  {
+    printf("%s: SCLK left high\n", what);
+    ok = false;
+  }
+  if (!(SREG & _BV(7)))
+  {
+    printf("%s: interrupts left off\n", what);
+    ok = false;
+  }
+
+  received.clear();
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  int frames = argc > 1 ? atoi(argv[1]) : 1000;
+  if (frames < 1)
+  {
+    fprintf(stderr, "Usage: %s [frames]\n", argv[0]);
+    return 2;
+  }
+
+  // Watching from the start, the SPI build waits on SPIF as soon as init() shifts a frame
+  srand(1);
+  registerWritten = watchRegisters;
+  sei();
+  Tlc.init();
+  TIMER1_OVF_vect();
+  otherPins = SIN_PORT & OTHER_MASK;
+  received.clear();
+
+  int failures = 0;
+  for (int frame = 0; frame < frames; frame++)
+  {
+    for (int i = 0; i < NUM_TLCS * 24; i++)
+      tlc_GSData[i] = rand();
+    Tlc.update();
+    failures += !checkReceived("update", tlc_GSData, NUM_TLCS * 24, 1);
+    TIMER1_OVF_vect();
+
+    uint8_t byte = rand();
+    tlc_shift8(byte);
+    failures += !checkReceived("tlc_shift8", &byte, 1, 0);
+  }
+
+  printf("%s, SIN on bit %d and SCLK on bit %d: %d frames, %ld interrupts, %s\n",
+         DATA_TRANSFER_MODE == TLC_BITBANG ? "bit-bang" : "SPI", SIN_PIN, SCLK_PIN, frames,
+         interrupts, failures ? "FAILED" : "ok");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,15 @@
+/**
+ * avr/interrupt.h
+ * Host stand-in for the AVR interrupt macros, see avr/io.h
+ */
+
+#ifndef AVR_INTERRUPT_H
+#define AVR_INTERRUPT_H
+
+#include "io.h"
+
+#define ISR(vector) void vector(void)
+#define cli() (SREG &= ~_BV(7))
+#define sei() (SREG |= _BV(7))
+
+#endif
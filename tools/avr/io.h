@@ -0,0 +1,93 @@
+/**
+ * avr/io.h
+ * Host stand-in for the ATmega2560 registers that AntdroidGenesis/Tlc5940.cpp uses
+ *
+ * Tools that build the TLC5940 library on the host pass -I. so that <avr/io.h> finds this file
+ * rather than the AVR toolchain's. Registers are plain memory and only hold what was last
+ * written to them. A tool can watch them by setting registerWritten, which is called after
+ * every write.
+ */
+
+#ifndef AVR_IO_H
+#define AVR_IO_H
+
+#include <stdint.h>
+
+#ifndef __AVR_ATmega2560__
+#define __AVR_ATmega2560__
+#endif
+
+#define _BV(bit) (1 << (bit))
+
+/** Called after every write to a register when set, with the register and what it held before */
+void (*registerWritten)(const void *reg, unsigned before) = 0;
+
+/** A register of T bits */
+template <typename T>
+class Register
+{
+public:
+  Register &operator=(unsigned value)
+  {
+    unsigned before = this->value;
+    this->value = value;
+    if (registerWritten)
+      registerWritten(this, before);
+    return *this;
+  }
+  Register &operator|=(unsigned bits) { return *this = value | bits; }
+  Register &operator&=(unsigned bits) { return *this = value & bits; }
+  operator unsigned() const { return value; }
+
+  T value;
+};
+
+typedef Register<uint8_t> Register8;
+typedef Register<uint16_t> Register16;
+
+/** Ports */
+Register8 PORTB, DDRB, PINB;
+Register8 PORTH, DDRH;
+
+/** Timer 1, BLANK and XLAT */
+Register8 TCCR1A, TCCR1B, TIFR1, TIMSK1;
+Register16 OCR1A, OCR1B, ICR1;
+
+/** Timer 2, GSCLK */
+Register8 TCCR2A, TCCR2B, OCR2A, OCR2B;
+
+/** SPI */
+Register8 SPCR, SPSR, SPDR;
+
+/** Status register, bit 7 enables interrupts */
+Register8 SREG;
+
+#define PORTB0 0
+#define PORTB1 1
+#define PORTB2 2
+#define PORTB3 3
+#define PORTB4 4
+#define PORTB5 5
+#define PORTB6 6
+#define PORTB7 7
+#define PORTH6 6
+
+#define COM1A1 7
+#define COM1B1 5
+#define WGM13 4
+#define CS10 0
+#define TOV1 0
+#define TOIE1 0
+
+#define COM2B1 5
+#define WGM20 0
+#define WGM21 1
+#define WGM22 3
+#define CS20 0
+
+#define SPE 6
+#define MSTR 4
+#define SPIF 7
+#define SPI2X 0
+
+#endif